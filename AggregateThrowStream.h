@@ -0,0 +1,270 @@
+/*! \file
+ *  \brief     Combine the exceptions from many failed tasks into one
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#ifndef BPLIB_AGGREGATETHROWSTREAM_H
+#define BPLIB_AGGREGATETHROWSTREAM_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "ThrowStream.h"
+
+
+//! A ThrowStream holding the exceptions from several failed tasks
+/*!
+ *  The exceptions are attached to the entry where the aggregate was created. Each
+ *  keeps its own backtrace (and may itself be an AggregateThrowStream). When
+ *  rendered, exceptions with the same callsite chain are grouped together and
+ *  printed once, with a count.
+ *
+ *  The aggregated exceptions are kept when this is appended to another ThrowStream
+ *  with THROWSTREAMAPPEND.
+ */
+class AggregateThrowStream : public ThrowStream
+{
+private:
+    std::shared_ptr<const std::vector<ThrowStreamChild>> _children; //!< The aggregated exceptions
+
+public:
+    //! Construct using the aggregated exceptions and a location
+    /*!
+     *  \param[in] children The aggregated exceptions
+     *  \param[in] loc Where the exception occurred
+     */
+    AggregateThrowStream(std::shared_ptr<const std::vector<ThrowStreamChild>> children,
+                         const ThrowStreamLocation & loc)
+        : ThrowStream(loc), _children(std::move(children))
+    {
+        SetChildren(_children);
+    }
+
+
+    //! Construct using the aggregated exceptions and the line, file, and function
+    /*!
+     *  \param[in] children The aggregated exceptions
+     *  \param[in] line The line on which the exception occurred
+     *  \param[in] file The file in which the exception occurred
+     *  \param[in] function function The function in which the exception occurred
+     */
+    AggregateThrowStream(std::shared_ptr<const std::vector<ThrowStreamChild>> children,
+                         const unsigned long line, const string & file, const string & function)
+        : ThrowStream(line, file, function), _children(std::move(children))
+    {
+        SetChildren(_children);
+    }
+
+
+    //! Get the aggregated exceptions
+    const std::vector<ThrowStreamChild> & Children() const
+    {
+        return *_children;
+    }
+
+
+    //! Get the number of aggregated exceptions
+    size_t Size() const
+    {
+        return _children->size();
+    }
+
+
+    //! Rethrow one of the aggregated exceptions, with its original type
+    /*!
+     *  A ThrowStream is thrown instead if \p i is out of range.
+     */
+    void Rethrow(size_t i) const
+    {
+        if(i >= _children->size())
+            THROWSTREAM << "Exception " << i << " requested, but only "
+                        << _children->size() << " were aggregated";
+        std::rethrow_exception((*_children)[i].ptr);
+    }
+
+
+    //! Add information to the current entry in the backtrace
+    /*!
+     *  Hides ThrowStream::operator<< so that THROWSTREAMAGGREGATE throws
+     *  an AggregateThrowStream rather than a plain ThrowStream.
+     */
+    template<typename T>
+    AggregateThrowStream & operator<<(const T & rhs)
+    {
+        ThrowStream::operator<<(rhs);
+        return *this;
+    }
+};
+
+
+//! Collects exceptions from many threads to be thrown as an AggregateThrowStream
+/*!
+ *  Each thread adds to its own buffer, so adding never takes a lock. The buffers
+ *  are kept in a lock-free list and are combined by Build(), which should only
+ *  be called once all the threads are finished.
+ *
+ *  A thread remembers the buffer of the last builder it used, so interleaving
+ *  adds to several builders on the same thread works but creates extra buffers.
+ *
+ *  \code{.cpp}
+ *    AggregateThrowStreamBuilder errors;
+ *    std::for_each(std::execution::par, items.begin(), items.end(), [&](Item & item)
+ *    {
+ *        try { Process(item); }
+ *        catch(...) { errors.AddCurrent(); }
+ *    });
+ *
+ *    if(!errors.Empty())
+ *        THROWSTREAMAGGREGATE(errors) << errors.Size() << " items failed";
+ *  \endcode
+ */
+class AggregateThrowStreamBuilder
+{
+private:
+    //! Exceptions added by a single thread
+    struct Buffer
+    {
+        std::vector<ThrowStreamChild> children;
+        Buffer * next;
+    };
+
+    const unsigned long _id;       //!< Unique id, used to find this thread's buffer
+    std::atomic<Buffer *> _buffers; //!< All buffers, newest first
+    std::atomic<size_t> _count;     //!< Number of exceptions added
+
+
+    //! Source of unique builder ids
+    static unsigned long NextId()
+    {
+        static std::atomic<unsigned long> next(1);
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+
+    //! Get this thread's buffer, creating it if needed
+    Buffer & LocalBuffer()
+    {
+        struct Cache
+        {
+            unsigned long id;
+            Buffer * buffer;
+        };
+        static thread_local Cache cache = { 0, nullptr };
+
+        if(cache.id != _id)
+        {
+            Buffer * b = new Buffer;
+            b->next = _buffers.load(std::memory_order_relaxed);
+            while(!_buffers.compare_exchange_weak(b->next, b, std::memory_order_release,
+                                                  std::memory_order_relaxed))
+                ;
+
+            cache.id = _id;
+            cache.buffer = b;
+        }
+
+        return *cache.buffer;
+    }
+
+
+public:
+    AggregateThrowStreamBuilder() : _id(NextId()), _buffers(nullptr), _count(0) { }
+
+    AggregateThrowStreamBuilder(const AggregateThrowStreamBuilder &) = delete;
+    AggregateThrowStreamBuilder & operator=(const AggregateThrowStreamBuilder &) = delete;
+
+    ~AggregateThrowStreamBuilder()
+    {
+        Buffer * b = _buffers.load(std::memory_order_acquire);
+        while(b != nullptr)
+        {
+            Buffer * next = b->next;
+            delete b;
+            b = next;
+        }
+    }
+
+
+    //! Add an exception. Safe to call from any number of threads at once
+    /*!
+     *  A ThrowStream is thrown if \p ptr is null (for example, from AddCurrent
+     *  outside of a catch block).
+     *
+     *  \param[in] ptr The exception to add
+     */
+    void Add(std::exception_ptr ptr)
+    {
+        if(!ptr)
+            THROWSTREAM << "Cannot aggregate a null exception";
+
+        ThrowStreamChild child = { ptr, nullptr, nullptr, nullptr };
+
+        // Rethrowing is the only way to get at the object itself
+        try
+        {
+            std::rethrow_exception(ptr);
+        }
+        catch(const ThrowStream & ts)
+        {
+            child.ex = &ts;
+            child.ts = &ts;
+        }
+        catch(const exception & ex)
+        {
+            child.ex = &ex;
+        }
+        catch(...)
+        {
+        }
+
+        LocalBuffer().children.push_back(std::move(child));
+        _count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+
+    //! Add the exception currently being handled (from within a catch block)
+    void AddCurrent()
+    {
+        Add(std::current_exception());
+    }
+
+
+    //! Number of exceptions added so far
+    size_t Size() const
+    {
+        return _count.load(std::memory_order_acquire);
+    }
+
+
+    //! Have any exceptions been added?
+    bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+
+    //! Create an AggregateThrowStream from everything added so far
+    /*!
+     *  This should only be called once the threads adding exceptions are finished.
+     *
+     *  \param[in] loc Where the exception occurred
+     */
+    AggregateThrowStream Build(const ThrowStreamLocation & loc) const
+    {
+        std::shared_ptr<std::vector<ThrowStreamChild>> children(new std::vector<ThrowStreamChild>);
+        children->reserve(Size());
+
+        // Buffers are stored newest first
+        std::vector<const Buffer *> buffers;
+        for(const Buffer * b = _buffers.load(std::memory_order_acquire); b != nullptr; b = b->next)
+            buffers.push_back(b);
+
+        for(size_t i = buffers.size(); i > 0; i--)
+            children->insert(children->end(), buffers[i-1]->children.begin(), buffers[i-1]->children.end());
+
+        return AggregateThrowStream(children, loc);
+    }
+};
+
+#endif //BPLIB_AGGREGATETHROWSTREAM_H
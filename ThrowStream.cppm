@@ -0,0 +1,147 @@
+/*! \file
+ *  \brief     The throwstream C++20 module (experimental)
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  \warning Experimental. This has not yet been compiled with a compiler that supports
+ *           modules, and is not installed. CMake only builds it with THROWSTREAM_MODULE=ON.
+ *
+ *  Exports everything in the ThrowStream headers, so the standard library headers
+ *  they use are only parsed once, when the module is built. Macros can't be
+ *  exported, so include ThrowStreamMacros.h for those:
+ *
+ *  \code{.cpp}
+ *    #include "ThrowStreamMacros.h"
+ *    import throwstream;
+ *
+ *    THROWSTREAM << "Can't open " << path;
+ *  \endcode
+ *
+ *  With C++20, ThrowStream::Here() can be used in place of the macros.
+ *
+ *  The module must be built with the same THROWSTREAM_* definitions as the
+ *  code importing it (THROWSTREAM_SOURCE_ROOT only matters to the macros).
+ *  Define THROWSTREAM_COMPILED to use the throwstream library. Otherwise the
+ *  module is where ThrowStream is compiled (see THROWSTREAM_IMPLEMENTATION).
+ */
+
+module;
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStream.h"
+#include "ThrowStreamCollector.h"
+#include "ThrowStreamPolicies.h"
+#include "ThrowStreamVars.h"
+
+#ifdef THROWSTREAM_EXCEPTIONS
+#include "AggregateThrowStream.h"
+#include "ThrowStreamCancel.h"
+#include "ThrowStreamDedupSink.h"
+#include "ThrowStreamSink.h"
+#include "ThrowStreamTask.h"
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include "ThrowStreamFd.h"
+#ifdef THROWSTREAM_EXCEPTIONS
+#include "ThrowStreamGather.h"
+#include "ThrowStreamTerminate.h"
+#endif
+#endif
+
+export module throwstream;
+
+// ThrowStream.h
+export using ::ThrowStreamBasic;
+export using ::ThrowStreamStringStorage;
+export using ::ThrowStreamStreamFormat;
+export using ::ThrowStreamTextRender;
+export using ::ThrowStream;
+export using ::ThrowStreamChild;
+export using ::ThrowStreamCategoryInfo;
+export using ::ThrowStreamCategoryBase;
+export using ::ThrowStreamLocation;
+export using ::ThrowStreamPrefixLength;
+export using ::ThrowStreamFingerprintAdd;
+export using ::ThrowStreamConstant;
+export using ::ThrowStreamSegmentFn;
+export using ::ThrowStreamDeferred;
+export using ::ThrowStreamDeferredRef;
+export using ::ThrowStreamFormatUnsigned;
+export using ::ThrowStreamVisitTemporary;
+export using ::ThrowStreamCancelled;
+export using ::ThrowStreamCancelFlag;
+export using ::ThrowStreamIsCancelled;
+export using ::ThrowStreamCheckCancelled;
+export using ::ThrowStreamRaise;
+export using ::ThrowStreamErrnoCode;
+export using ::operator<<;
+
+#ifndef THROWSTREAM_EXCEPTIONS
+// ThrowStreamNoExcept.h
+export using ::ThrowStreamFailureHandler;
+export using ::ThrowStreamAbortHandler;
+export using ::ThrowStreamSetFailureHandler;
+export using ::ThrowStreamRaised;
+export using ::ThrowStreamRaiser;
+export using ::ThrowStreamCheckpoint;
+export using ::ThrowStreamLongjmpHandler;
+#endif
+
+// ThrowStreamCollector.h
+export using ::ThrowStreamCollector;
+export using ::ThrowStreamCollectorEntry;
+
+// ThrowStreamPolicies.h
+export using ::ThrowStreamFixedText;
+export using ::ThrowStreamFixedStorage;
+export using ::ThrowStreamCompactRender;
+export using ::ThrowStreamDeferredValue;
+export using ::ThrowStreamDeferredFormat;
+
+// ThrowStreamVars.h
+export using ::ThrowStreamVarLayout;
+export using ::ThrowStreamMakeVars;
+
+#ifdef THROWSTREAM_EXCEPTIONS
+// AggregateThrowStream.h
+export using ::AggregateThrowStream;
+export using ::AggregateThrowStreamBuilder;
+
+// ThrowStreamCancel.h
+export using ::ThrowStreamCancelToken;
+export using ::ThrowStreamCancelScope;
+
+// ThrowStreamDedupSink.h
+export using ::ThrowStreamDedupSink;
+
+// ThrowStreamSink.h
+export using ::ThrowStreamSink;
+
+// ThrowStreamTask.h
+export using ::ThrowStreamTask;
+export using ::ThrowStreamMakeTask;
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+// ThrowStreamFd.h
+export using ::ThrowStreamIovecWriter;
+export using ::ThrowStreamWriteFd;
+export using ::ThrowStreamWriteAll;
+export using ::ThrowStreamSafeWriter;
+export using ::ThrowStreamRenderToFd;
+
+#ifdef THROWSTREAM_EXCEPTIONS
+// ThrowStreamGather.h
+export using ::ThrowStreamSend;
+export using ::ThrowStreamGather;
+
+// ThrowStreamTerminate.h
+export using ::ThrowStreamTerminateHook;
+export using ::ThrowStreamTerminateSettings;
+export using ::ThrowStreamTerminateConfig;
+export using ::ThrowStreamTerminateWrite;
+export using ::ThrowStreamTerminateHandler;
+export using ::ThrowStreamInstallTerminateHandler;
+#endif
+#endif
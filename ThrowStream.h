@@ -10,7 +10,42 @@
 #include <exception>
 #include <string>
 #include <sstream>
-#include <iostream>
+#include <ostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <system_error>
+#include "ThrowStreamMacros.h"
+
+
+// Is RTTI available? Define THROWSTREAM_NO_RTTI to avoid using it anyway
+#if !defined(THROWSTREAM_NO_RTTI) && (defined(__GXX_RTTI) || defined(_CPPRTTI) || defined(__cpp_rtti))
+#define THROWSTREAM_RTTI
+#endif
+
+// Rendering and other code that isn't needed to throw is compiled once, rather than in
+// every file that throws: in the throwstream library (define THROWSTREAM_COMPILED when
+// linking to it), or else in the one file of the program that defines
+// THROWSTREAM_IMPLEMENTATION before including this header
+#if defined(THROWSTREAM_LIBRARY_SOURCE) || (defined(THROWSTREAM_IMPLEMENTATION) && !defined(THROWSTREAM_COMPILED))
+#define THROWSTREAM_IMPLEMENTATION_FILE
+#endif
+
+// Marks functions that are defined only in that one file
+#define THROWSTREAM_COLD
+
+// Is std::source_location available? If so, it can be used in place of the macros
+#if defined(__has_include)
+#if __cplusplus >= 202002L && __has_include(<source_location>)
+#include <source_location>
+#if defined(__cpp_lib_source_location)
+#define THROWSTREAM_SOURCE_LOCATION
+#endif
+#endif
+#endif
 
 
 using std::string;
@@ -19,105 +54,1206 @@ using std::ostream;
 using std::stringstream;
 
 
-// Forward declaration
-class ThrowStream;
-ostream & operator<<(ostream & os, const ThrowStream & ts);
+// Forward declarations
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+class ThrowStreamBasic;
+
+struct ThrowStreamStringStorage;
+struct ThrowStreamStreamFormat;
+struct ThrowStreamTextRender;
+
+class ThrowStreamWireWriter;
+class ThrowStreamWireReader;
+
+//! The ThrowStream class, with the default policies. See ThrowStreamBasic
+typedef ThrowStreamBasic<ThrowStreamStringStorage, ThrowStreamStreamFormat, ThrowStreamTextRender> ThrowStream;
+
+
+//! An exception collected from a task, for use in an aggregate (see AggregateThrowStream)
+/*!
+ *  The exception_ptr keeps the original object (with its original type) alive,
+ *  so the plain pointers stay valid for as long as this does. Without exceptions,
+ *  \p held does that instead.
+ */
+struct ThrowStreamChild
+{
+    std::exception_ptr ptr;  //!< The original exception
+    const exception * ex;    //!< The original exception as an std::exception (null if it isn't one)
+    const ThrowStream * ts;  //!< The original exception as a ThrowStream (null if it isn't one)
+
+    //! Printed in place of the count, if set. The exception is then never grouped with others
+    /*!
+     *  Used by ThrowStreamGather, which groups exceptions itself and labels each
+     *  with the ranks it came from.
+     */
+    std::shared_ptr<const string> label;
+
+    //! Keeps \p ts alive when there is no exception_ptr (from Deserialize, without exceptions)
+    std::shared_ptr<const ThrowStream> held;
+};
+
+
+//! Describes an error category (see THROWSTREAMCATEGORY)
+/*!
+ *  There is a single static object for each category, so categories can
+ *  be compared by address.
+ */
+struct ThrowStreamCategoryInfo
+{
+    const char * name;                      //!< Name of the category
+    const ThrowStreamCategoryInfo * parent; //!< The category this is derived from (null if none)
+};
+
+
+//! Length of the directory \p prefix (and a following '/') if \p path is inside it, otherwise 0
+/*!
+ *  The prefix only matches whole directory names, so "/src/pro" does not match
+ *  "/src/project/a.cpp". Used by THROWSTREAMFILE to trim THROWSTREAM_SOURCE_ROOT
+ *  at compile time.
+ */
+constexpr size_t ThrowStreamPrefixLength(const char * path, const char * prefix, size_t i = 0)
+{
+    return (prefix[i] == 0) ? ((i > 0 && prefix[i-1] == '/') ? i
+                               : (i > 0 && path[i] == '/') ? i + 1
+                               : 0)
+         : (path[i] == prefix[i]) ? ThrowStreamPrefixLength(path, prefix, i + 1)
+         : 0;
+}
+
+//! Add some bytes to a fingerprint (64-bit FNV-1a). See ThrowStreamBasic::Fingerprint
+/*!
+ *  \param[in] h The fingerprint so far
+ *  \param[in] data The bytes to add
+ *  \param[in] size Number of bytes
+ *  \return The new fingerprint
+ */
+inline uint64_t ThrowStreamFingerprintAdd(uint64_t h, const void * data, size_t size)
+{
+    const unsigned char * p = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+
+//! Holds a value computed at compile time (used by THROWSTREAMFILE)
+template<size_t N>
+struct ThrowStreamConstant
+{
+    static const size_t value = N;
+};
+
+
+//! Where an entry in the backtrace was added
+/*!
+ *  Only pointers are stored, so creating one costs nothing. The strings must
+ *  last for as long as any exception using them (literals such as __FILE__ and
+ *  __FUNCTION__ always do). Otherwise, use the overloads of ThrowStream::Append
+ *  that take std::string, which copy them.
+ */
+struct ThrowStreamLocation
+{
+    unsigned long line;     //!< The line (0 if unknown)
+    unsigned long column;   //!< The column (0 if unknown)
+    const char * file;      //!< The file
+    const char * function;  //!< The function
+    bool signature;         //!< True if \p function is a full signature, rather than just the name
+
+    //! Construct from the line, file, function, and (optionally) column
+    ThrowStreamLocation(unsigned long l, const char * f, const char * fn, unsigned long c = 0)
+        : line(l), column(c), file(f), function(fn), signature(false)
+    { }
+
+#ifdef THROWSTREAM_SOURCE_LOCATION
+    //! Construct from an std::source_location (which includes the column)
+    ThrowStreamLocation(const std::source_location & loc)
+        : line(loc.line()), column(loc.column()), file(loc.file_name()),
+          function(loc.function_name()), signature(true)
+    { }
+#endif
+};
+
+
+//! Receives one piece of a rendered backtrace (see ThrowStream::VisitSegments)
+typedef void (*ThrowStreamSegmentFn)(void * ctx, const char * data, size_t size);
+
+
+//! Pieces of a rendered backtrace longer than this always outlive the call that passes them
+/*!
+ *  Anything temporary is passed in pieces no longer than this (see ThrowStreamVisitTemporary),
+ *  so a ThrowStreamSegmentFn only needs to copy the short ones to keep them.
+ */
+const size_t ThrowStreamTemporarySegment = 32;
+
+
+//! Pass on data that is only valid until \p fn returns
+/*!
+ *  The data is split into pieces of at most ThrowStreamTemporarySegment bytes.
+ *
+ *  \param[in] fn Function to call with each piece
+ *  \param[in] ctx Passed to \p fn unchanged
+ *  \param[in] data The data to pass on
+ *  \param[in] size Number of bytes in \p data
+ */
+inline void ThrowStreamVisitTemporary(ThrowStreamSegmentFn fn, void * ctx, const char * data, size_t size)
+{
+    while(size > ThrowStreamTemporarySegment)
+    {
+        fn(ctx, data, ThrowStreamTemporarySegment);
+        data += ThrowStreamTemporarySegment;
+        size -= ThrowStreamTemporarySegment;
+    }
+    fn(ctx, data, size);
+}
+
+
+//! Part of a message that is only formatted when the backtrace is rendered
+/*!
+ *  Added to an entry with ThrowStream::AddDeferred. The object is shared between
+ *  copies of the ThrowStream, so it must not change once added.
+ */
+class ThrowStreamDeferred
+{
+public:
+    virtual ~ThrowStreamDeferred() { }
+
+    //! Render this piece
+    /*!
+     *  Anything that doesn't live as long as this object (such as text formatted
+     *  here) must be passed with ThrowStreamVisitTemporary.
+     *
+     *  \param[in] fn Function to call with each piece of the output
+     *  \param[in] ctx Passed to \p fn unchanged
+     *  \param[in] safe If true, skip anything that may allocate (see ThrowStream::VisitSegments)
+     */
+    virtual void Visit(ThrowStreamSegmentFn fn, void * ctx, bool safe) const = 0;
+};
+
+
+//! Holds a ThrowStreamDeferred so that it can be added with the stream operator
+struct ThrowStreamDeferredRef
+{
+    std::shared_ptr<const ThrowStreamDeferred> piece;
+};
+
+
+//! Write an unsigned number in decimal, without a terminating null
+/*!
+ *  Uses no locale or allocation, so it is safe to call from a signal handler.
+ *
+ *  \param[out] buf Buffer to write to. Must hold at least 20 characters
+ *  \param[in] value The number to write
+ *  \return The number of characters written
+ */
+inline size_t ThrowStreamFormatUnsigned(char * buf, unsigned long long value)
+{
+    char tmp[20];
+    size_t n = 0;
+    do
+    {
+        tmp[n++] = char('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+
+    for(size_t i = 0; i < n; i++)
+        buf[i] = tmp[n - 1 - i];
+    return n;
+}
+
+
+//! Passes segments on, adding an indent after each newline
+struct ThrowStreamIndent
+{
+    ThrowStreamSegmentFn fn;
+    void * ctx;
+
+    static void Call(void * self, const char * data, size_t size)
+    {
+        const ThrowStreamIndent * ind = static_cast<const ThrowStreamIndent *>(self);
+        const char * end = data + size;
+        while(data < end)
+        {
+            const char * nl = static_cast<const char *>(memchr(data, '\n', end - data));
+            if(nl == nullptr)
+            {
+                ind->fn(ind->ctx, data, end - data);
+                break;
+            }
+
+            if(nl > data)
+                ind->fn(ind->ctx, data, nl - data);
+            ind->fn(ind->ctx, "\n    ", 5);
+            data = nl + 1;
+        }
+    }
+};
+
+
+//! Do two aggregated exceptions have the same callsite chain?
+/*!
+ *  Only the locations are compared, not the messages. Exceptions that
+ *  aren't ThrowStreams are compared by their description.
+ */
+THROWSTREAM_COLD bool ThrowStreamSameChain(const ThrowStreamChild & a, const ThrowStreamChild & b);
+
+
+//! Render exceptions aggregated at an entry, grouping those with the same callsite chain
+THROWSTREAM_COLD void ThrowStreamVisitChildren(const std::vector<ThrowStreamChild> & children,
+                                               ThrowStreamSegmentFn fn, void * ctx, bool safe);
+
+
+//! Storage policy: messages are kept in an std::string
+struct ThrowStreamStringStorage
+{
+    typedef string Text; //!< Holds the message of an entry
+};
+
+
+//! Format policy: values are added to a message through a stringstream
+struct ThrowStreamStreamFormat
+{
+    //! Add a value to a message
+    /*!
+     *  \param[in] ts The exception being added to (not used here)
+     *  \param[in,out] text The message of its last entry
+     *  \param[in] value The value to add
+     */
+    template<typename Owner, typename Text, typename T>
+    static void Append(Owner & ts, Text & text, const T & value)
+    {
+        (void)ts;
+        stringstream ss;
+        ss << value;
+        const string str = ss.str();
+        text.append(str.data(), str.size());
+    }
+};
+
+
+//! Render policy: the usual layout of what()
+/*!
+ *  With THROWSTREAM_EXCEPTIONSOURCE defined, each entry starts with
+ *  "( file:line , in function() )    ->  ". Otherwise only the messages are written.
+ */
+struct ThrowStreamTextRender
+{
+    //! Write the location of an entry, ahead of its message
+    template<typename Frame>
+    static void VisitLocation(const Frame & f, ThrowStreamSegmentFn fn, void * ctx)
+    {
+#ifdef THROWSTREAM_EXCEPTIONSOURCE
+        char line[24];
+        fn(ctx, "( ", 2);
+        fn(ctx, f.file, strlen(f.file));
+        fn(ctx, ":", 1);
+        fn(ctx, line, ThrowStreamFormatUnsigned(line, f.line));
+        if(f.column != 0)
+        {
+            fn(ctx, ":", 1);
+            fn(ctx, line, ThrowStreamFormatUnsigned(line, f.column));
+        }
+        fn(ctx, " , in ", 6);
+        fn(ctx, f.function, strlen(f.function));
+
+        if(f.signature)
+            fn(ctx, " )    ->  ", 10);
+        else
+            fn(ctx, "() )    ->  ", 12);
+#else
+        (void)f;
+        (void)fn;
+        (void)ctx;
+#endif
+    }
+};
+
+
+//! Main ThrowStream class
+/*!
+    This class allows appending of exception information, creating a backtrace-like
+    output.
+
+    The policies decide how messages are stored, how values added with the stream
+    operator are formatted, and how what() lays out each entry. ThrowStream uses
+    the defaults (ThrowStreamStringStorage, ThrowStreamStreamFormat, ThrowStreamTextRender),
+    and is what the macros throw. Other combinations are separate types, and see
+    each other (and ThrowStream) only as std::exceptions.
+
+    \tparam StoragePolicy Provides \p Text, the type holding each message
+    \tparam FormatPolicy Provides Append(ts, text, value), used by the stream operator
+                         to add a value to \p text, the message of the last entry of \p ts
+    \tparam RenderPolicy Provides VisitLocation(frame, fn, ctx), which writes the
+                         location of an entry ahead of its message
+ */
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+class ThrowStreamBasic : public exception
+{
+public:
+    //! Receives one piece of a rendered backtrace (see VisitSegments)
+    typedef ThrowStreamSegmentFn SegmentFn;
+
+
+    //! A ThrowStreamDeferred and where it goes in the message of an entry
+    struct DeferredInsert
+    {
+        size_t offset;                                   //!< Position in the message
+        std::shared_ptr<const ThrowStreamDeferred> piece; //!< What to insert there
+    };
+
+
+    //! A single entry in the backtrace
+    /*!
+     *  An exception that isn't a ThrowStream is stored as its own entry, with no location.
+     *  If it was copied while being handled, the original object is kept (with its type)
+     *  in \p nested and its description is only read when rendering. Otherwise its
+     *  description is copied into \p message.
+     */
+    struct Frame
+    {
+        unsigned long line = 0;       //!< The line on which the entry was added
+        unsigned long column = 0;     //!< The column on which the entry was added (0 if unknown)
+        const char * file = "";       //!< The file in which the entry was added
+        const char * function = "";   //!< The function in which the entry was added
+        std::shared_ptr<const string> names; //!< Owns \p file and \p function if they were copied (may be null)
+        bool signature = false;       //!< True if \p function includes the arguments
+        typename StoragePolicy::Text message; //!< Information added with the stream operator
+
+        //! Parts of the message that are formatted when rendering, in order
+        std::vector<DeferredInsert> deferred;
+
+        //! Exceptions aggregated at this entry (may be null)
+        std::shared_ptr<const std::vector<ThrowStreamChild>> children;
+
+        bool external = false;    //!< True if this is an exception that isn't a ThrowStream
+        std::exception_ptr nested;              //!< The original exception (external entries only)
+        const exception * nestedEx = nullptr;   //!< The object held by \p nested
+
+        int errorValue = 0;                                //!< Error code added at this entry
+        const std::error_category * errorCategory = nullptr; //!< Category of \p errorValue (null if none)
+
+        //! The description of an external entry
+        const char * ExternalWhat() const
+        {
+            return (nestedEx != nullptr) ? nestedEx->what() : message.c_str();
+        }
+
+        //! The error code added at this entry (an empty error_code if none)
+        std::error_code ErrorCode() const
+        {
+            if(errorCategory == nullptr)
+                return std::error_code();
+            return std::error_code(errorValue, *errorCategory);
+        }
+    };
+
+private:
+    std::vector<Frame> _frames; //!< All entries of the backtrace, oldest first
+
+    //! The error category (null if none). See THROWSTREAMCATEGORY
+    const ThrowStreamCategoryInfo * _category = nullptr;
+
+    //! Hash of the callsite chain, updated as entries are added. See Fingerprint
+    uint64_t _fingerprint = 14695981039346656037ULL; // FNV-1a offset basis
+
+    //! The full backtrace, rendered by what() the first time it is needed
+    /*!
+     *  Rendering is done on demand so that exceptions that are caught and handled
+     *  never pay for it. The rendered string is published atomically, so what()
+     *  may be called from several threads at once.
+     */
+    mutable std::atomic<const string *> _desc;
+
+
+    //! Discard the rendered backtrace after the entries have changed
+    void Invalidate()
+    {
+        delete _desc.exchange(nullptr, std::memory_order_acq_rel);
+    }
+
+
+    //! Copy a file and function name into one string, for Frame::names
+    /*!
+     *  The function follows the file, after its terminating null character.
+     */
+    static std::shared_ptr<const string> CopyNames(const string & file, const string & function)
+    {
+        std::shared_ptr<string> names = std::make_shared<string>(file);
+        names->push_back('\0');
+        names->append(function);
+        return names;
+    }
+
+
+    //! Add an entry to the end of the backtrace, and to the fingerprint
+    void PushFrame(Frame && f)
+    {
+        _fingerprint = FingerprintFrame(_fingerprint, f);
+        _frames.push_back(std::move(f));
+    }
+
+
+    //! Add the location of an entry to a fingerprint
+    /*!
+     *  The file and function are used, and the line if THROWSTREAM_FINGERPRINT_LINE
+     *  is defined. Entries that aren't ThrowStreams all count as the same.
+     */
+    static uint64_t FingerprintFrame(uint64_t h, const Frame & f)
+    {
+        if(f.external)
+            return ThrowStreamFingerprintAdd(h, "\x01", 2);
+
+        h = ThrowStreamFingerprintAdd(h, f.file, strlen(f.file) + 1);
+        h = ThrowStreamFingerprintAdd(h, f.function, strlen(f.function) + 1);
+#ifdef THROWSTREAM_FINGERPRINT_LINE
+        const unsigned char line[4] = { (unsigned char)(f.line), (unsigned char)(f.line >> 8),
+                                        (unsigned char)(f.line >> 16), (unsigned char)(f.line >> 24) };
+        h = ThrowStreamFingerprintAdd(h, line, 4);
+#endif
+        return h;
+    }
+
+
+    //! Find out if an exception is really a ThrowStream
+    /*!
+     *  With RTTI, this is a dynamic_cast. Without it (or if \p ex isn't a ThrowStream),
+     *  the exception currently being handled is rethrown and compared with \p ex. That
+     *  works for THROWSTREAMAPPEND and THROWSTREAMOBJAPPENDCOPY inside a catch block,
+     *  which is where they are normally used. Outside of a handler, without RTTI,
+     *  \p ex is treated as a foreign exception.
+     *
+     *  \param[in] ex The exception to check
+     *  \param[out] ptr If \p ex is a foreign exception that is currently being handled,
+     *                  set to the current exception
+     *  \return \p ex as a ThrowStream, or null if it isn't one
+     */
+    static const ThrowStreamBasic * Identify(const exception & ex, std::exception_ptr & ptr)
+    {
+#ifdef THROWSTREAM_RTTI
+        const ThrowStreamBasic * pts = dynamic_cast<const ThrowStreamBasic *>(&ex);
+        if(pts != nullptr)
+            return pts;
+#endif
+
+#ifdef THROWSTREAM_EXCEPTIONS
+        std::exception_ptr current = std::current_exception();
+        if(!current)
+            return nullptr;
+
+        // Rethrowing is the only portable way to get at the object
+        try
+        {
+            std::rethrow_exception(current);
+        }
+        catch(const ThrowStreamBasic & ts)
+        {
+            if(&ts == &ex)
+                return &ts;
+        }
+        catch(const exception & e)
+        {
+            if(&e == &ex)
+                ptr = current;
+        }
+        catch(...)
+        {
+        }
+#else
+        (void)ex;
+        (void)ptr;
+#endif
+        return nullptr;
+    }
+
+
+    //! Render the message of an entry, with its deferred parts
+    static void VisitMessage(const Frame & f, SegmentFn fn, void * ctx, bool safe);
+
+
+    //! Render the error code of an entry
+    /*!
+     *  The message is only looked up here, never when the exception is thrown.
+     *  If \p safe is set, only the category name and the number are written,
+     *  since looking up the message may allocate.
+     */
+    static void VisitErrorCode(const Frame & f, SegmentFn fn, void * ctx, bool safe);
+
+
+    //! Adds segments to a string
+    static void AppendSegment(void * str, const char * data, size_t size);
+
+
+    //! Render the full backtrace
+    string Render() const;
+
+
+    //! Write the entries in the binary format (see Serialize)
+    void WriteWire(ThrowStreamWireWriter & w) const;
+
+
+    //! Read entries written by WriteWire
+    /*!
+     *  \param[in] depth How deeply this is nested in aggregated exceptions
+     */
+    void ReadWire(ThrowStreamWireReader & r, int depth);
+
+
+    //! Construct with no entries (used by Deserialize, which adds them)
+    ThrowStreamBasic()
+        : _desc(nullptr)
+    { }
+
+
+    // Aggregated exceptions are always plain ThrowStreams, which are read and written
+    // from here regardless of the policies
+    template<typename, typename, typename>
+    friend class ThrowStreamBasic;
+
+
+public:
+    // Constructors
+    //! Construct using a location
+    /*!
+     *  Only pointers are stored (see ThrowStreamLocation), so nothing is copied.
+     *  This is what the macros use.
+     *
+     *  \param[in] loc Where the exception occurred
+     */
+    explicit ThrowStreamBasic(const ThrowStreamLocation & loc)
+        : _desc(nullptr)
+    {
+        Append(loc);
+    }
+
+
+    //! Construct using the line, file, and function
+    /*!
+     *  The file and function names are copied, and owned by the exception.
+     *
+     *  \param[in] line The line on which the exception occurred
+     *  \param[in] file The file in which the exception occurred
+     *  \param[in] function function The function in which the exception occurred
+     */
+    ThrowStreamBasic(const unsigned long line, const string & file, const string & function)
+        : _desc(nullptr)
+    {
+        Append(line, file, function);
+    }
+
+
+    //! Construct by copying an exception and adding a new location
+    /*!
+     *  \param[in] ex An exception to copy
+     *  \param[in] loc Where the exception occurred
+     */
+    ThrowStreamBasic(const exception & ex, const ThrowStreamLocation & loc)
+        : _desc(nullptr)
+    {
+        Append(ex, loc);
+    }
+
+
+    //! Construct by copying an exception and adding a new line, file, and function
+    /*!
+     *  \param[in] ex An exception to copy
+     *  \param[in] line The line on which the exception occurred
+     *  \param[in] file The file in which the exception occurred
+     *  \param[in] function function The function in which the exception occurred
+     */
+    ThrowStreamBasic(const exception & ex, unsigned long line, const string & file, const string & function)
+        : _desc(nullptr)
+    {
+        Append(ex, line, file, function);
+    }
+
+
+    //! Construct by copying a ThrowStream and adding a new location
+    /*!
+     *  Chosen over the std::exception version when the argument is known to be a
+     *  ThrowStream at compile time, so no checking is needed.
+     *
+     *  \param[in] ts A ThrowStream to copy
+     *  \param[in] loc Where the exception occurred
+     */
+    ThrowStreamBasic(const ThrowStreamBasic & ts, const ThrowStreamLocation & loc)
+        : _desc(nullptr)
+    {
+        Append(ts, loc);
+    }
+
+
+    //! Construct by copying a ThrowStream and adding a new line, file, and function
+    /*!
+     *  \param[in] ts A ThrowStream to copy
+     *  \param[in] line The line on which the exception occurred
+     *  \param[in] file The file in which the exception occurred
+     *  \param[in] function function The function in which the exception occurred
+     */
+    ThrowStreamBasic(const ThrowStreamBasic & ts, unsigned long line, const string & file, const string & function)
+        : _desc(nullptr)
+    {
+        Append(ts, line, file, function);
+    }
+
+
+    //! Construct using an error code and a location
+    /*!
+     *  Only the code is stored. Its message is looked up when the exception is rendered.
+     *
+     *  \param[in] ec The error code (see SetErrorCode)
+     *  \param[in] loc Where the exception occurred
+     */
+    ThrowStreamBasic(const std::error_code & ec, const ThrowStreamLocation & loc)
+        : _desc(nullptr)
+    {
+        Append(loc);
+        SetErrorCode(ec);
+    }
+
+
+    //! Construct using an error code and the line, file, and function
+    /*!
+     *  \param[in] ec The error code (see SetErrorCode)
+     *  \param[in] line The line on which the exception occurred
+     *  \param[in] file The file in which the exception occurred
+     *  \param[in] function function The function in which the exception occurred
+     */
+    ThrowStreamBasic(const std::error_code & ec, unsigned long line, const string & file, const string & function)
+        : _desc(nullptr)
+    {
+        Append(line, file, function);
+        SetErrorCode(ec);
+    }
+
+
+#ifdef THROWSTREAM_SOURCE_LOCATION
+    //! Create a ThrowStream at the caller's location, without using a macro
+    /*!
+     *  \code{.cpp}
+     *    throw ThrowStream::Here() << "Some description: " << somevar;
+     *  \endcode
+     *
+     *  The column is included, and the function name is the full signature
+     *  given by std::source_location.
+     *
+     *  \param[in] loc The location (defaults to the caller's)
+     */
+    static ThrowStreamBasic Here(std::source_location loc = std::source_location::current())
+    {
+        return ThrowStreamBasic(ThrowStreamLocation(loc));
+    }
+#endif
+
+
+    //! Copy constructor. The rendered backtrace is not copied
+    ThrowStreamBasic(const ThrowStreamBasic & rhs)
+        : exception(rhs), _frames(rhs._frames), _category(rhs._category),
+          _fingerprint(rhs._fingerprint), _desc(nullptr)
+    { }
+
+
+    //! Move constructor
+    ThrowStreamBasic(ThrowStreamBasic && rhs)
+        : exception(rhs), _frames(std::move(rhs._frames)), _category(rhs._category),
+          _fingerprint(rhs._fingerprint), _desc(nullptr)
+    {
+        rhs.Invalidate();
+    }
+
+
+    //! Copy an exception that uses other policies
+    /*!
+     *  Every entry is copied, but is rendered the way this type renders it.
+     *  Used by ThrowStreamRaise to pass any ThrowStreamBasic to the failure
+     *  handler when exceptions are disabled.
+     *
+     *  \param[in] rhs The exception to copy
+     */
+    template<typename S, typename F, typename R>
+    explicit ThrowStreamBasic(const ThrowStreamBasic<S, F, R> & rhs)
+        : _category(rhs._category), _fingerprint(rhs._fingerprint), _desc(nullptr)
+    {
+        _frames.reserve(rhs._frames.size());
+        for(size_t i = 0; i < rhs._frames.size(); i++)
+        {
+            const typename ThrowStreamBasic<S, F, R>::Frame & src = rhs._frames[i];
+            Frame f;
+            f.line = src.line;
+            f.column = src.column;
+            f.file = src.file;
+            f.function = src.function;
+            f.names = src.names;
+            f.signature = src.signature;
+            f.message.append(src.message.data(), src.message.size());
+            for(size_t j = 0; j < src.deferred.size(); j++)
+            {
+                DeferredInsert d = { src.deferred[j].offset, src.deferred[j].piece };
+                f.deferred.push_back(std::move(d));
+            }
+            f.children = src.children;
+            f.external = src.external;
+            f.nested = src.nested;
+            f.nestedEx = src.nestedEx;
+            f.errorValue = src.errorValue;
+            f.errorCategory = src.errorCategory;
+            _frames.push_back(std::move(f));
+        }
+    }
+
+
+    //! Assignment operator
+    ThrowStreamBasic & operator=(const ThrowStreamBasic & rhs)
+    {
+        if(this != &rhs)
+        {
+            _frames = rhs._frames;
+            _category = rhs._category;
+            _fingerprint = rhs._fingerprint;
+            Invalidate();
+        }
+        return *this;
+    }
+
+
+    //! Destructor definition needed to declare it throw()
+    ~ThrowStreamBasic() throw()
+    {
+        delete _desc.load(std::memory_order_acquire);
+    }
+
+
+    //! Add a new location to the backtrace
+    /*!
+     *  This returns ThrowStream & to allow using operator<<
+     *
+     *  \param[in] loc Where the exception occurred
+     */
+    ThrowStreamBasic & Append(const ThrowStreamLocation & loc)
+    {
+        Frame f;
+        f.line = loc.line;
+        f.column = loc.column;
+        f.file = loc.file;
+        f.function = loc.function;
+        f.signature = loc.signature;
+        PushFrame(std::move(f));
+        Invalidate();
+
+        return *this;
+    }
+
+
+    //! Add a new line to the backtrace
+    /*!
+     *  This returns ThrowStream & to allow using operator<<. The file and
+     *  function names are copied, and owned by the new entry.
+     *
+     *  \param[in] line The line on which the exception occurred
+     *  \param[in] file The file in which the exception occurred
+     *  \param[in] function function The function in which the exception occurred
+     */
+    ThrowStreamBasic & Append(const unsigned long line, const string & file, const string & function)
+    {
+        std::shared_ptr<const string> names = CopyNames(file, function);
+        Append(ThrowStreamLocation(line, names->c_str(), names->c_str() + file.size() + 1));
+        _frames.back().names = std::move(names);
+        return *this;
+    }
+
+
+    //! Add a new location to the backtrace, copying an existing exception
+    /*!
+     *  This returns ThrowStream & to allow using operator<<
+     *
+     *  \param[in] ex An exception to copy
+     *  \param[in] loc Where the exception occurred
+     */
+    ThrowStreamBasic & Append(const exception & ex, const ThrowStreamLocation & loc)
+    {
+        //depends on if this is actually a throwstream
+        std::exception_ptr current;
+        const ThrowStreamBasic * pts = Identify(ex, current);
+        if(pts != nullptr)
+            return Append(*pts, loc);
 
+        // Keep the original exception if it is the one being handled,
+        // otherwise all we can do is copy its description
+        Frame f;
+        f.external = true;
+        if(current)
+        {
+            f.nested = current;
+            f.nestedEx = &ex;
+        }
+        else
+            f.message = ex.what();
+        PushFrame(std::move(f));
 
-//! Main ThrowStream class
-/*!
-    This class allows appending of exception information, creating a backtrace-like
-    output.
- */
-class ThrowStream : public exception
-{
-private:
-    string _desc; //!< The current, full backtrace
+        Append(loc);
 
-public:
-    friend ostream & operator<<(ostream & os, const ThrowStream & ts);
+        return *this;
+    }
 
-    // Constructors
-    //! Construct using the line, file, and function
+
+    //! Add a new line to the backtrace, copying an existing exception
     /*!
+     *  \param[in] ex An exception to copy
      *  \param[in] line The line on which the exception occurred
      *  \param[in] file The file in which the exception occurred
      *  \param[in] function function The function in which the exception occurred
      */
-    ThrowStream(const unsigned long line, const string & file, const string & function)
+    ThrowStreamBasic & Append(const exception & ex, const unsigned long line,
+                         const string & file, const string & function)
     {
-        Append(line, file, function);
+        std::shared_ptr<const string> names = CopyNames(file, function);
+        Append(ex, ThrowStreamLocation(line, names->c_str(), names->c_str() + file.size() + 1));
+        _frames.back().names = std::move(names);
+        return *this;
     }
 
 
-    //! Construct by copying an exception and adding a new line, file, and function
+    //! Add a new location to the backtrace, copying an existing ThrowStream
     /*!
-     *  \param[in] ex An exception to copy
+     *  Chosen over the std::exception version when the argument is known to be a
+     *  ThrowStream at compile time, so no checking is needed.
+     *
+     *  \param[in] ts A ThrowStream to copy
+     *  \param[in] loc Where the exception occurred
+     */
+    ThrowStreamBasic & Append(const ThrowStreamBasic & ts, const ThrowStreamLocation & loc)
+    {
+        if(_frames.empty())
+            _fingerprint = ts._fingerprint;
+        else
+        {
+            for(size_t i = 0; i < ts._frames.size(); i++)
+                _fingerprint = FingerprintFrame(_fingerprint, ts._frames[i]);
+        }
+        if(&ts == this)
+        {
+            // Inserting a vector's own elements into it is undefined
+            std::vector<Frame> frames(_frames);
+            _frames.insert(_frames.end(), frames.begin(), frames.end());
+        }
+        else
+            _frames.insert(_frames.end(), ts._frames.begin(), ts._frames.end());
+        if(_category == nullptr)
+            _category = ts._category;
+        Append(loc);
+
+        return *this;
+    }
+
+
+    //! Add a new line to the backtrace, copying an existing ThrowStream
+    /*!
+     *  \param[in] ts A ThrowStream to copy
      *  \param[in] line The line on which the exception occurred
      *  \param[in] file The file in which the exception occurred
      *  \param[in] function function The function in which the exception occurred
      */
-    ThrowStream(const exception & ex, unsigned long line, const string & file, const string & function)
+    ThrowStreamBasic & Append(const ThrowStreamBasic & ts, const unsigned long line,
+                         const string & file, const string & function)
     {
-        Append(ex, line, file, function);
+        std::shared_ptr<const string> names = CopyNames(file, function);
+        Append(ts, ThrowStreamLocation(line, names->c_str(), names->c_str() + file.size() + 1));
+        _frames.back().names = std::move(names);
+        return *this;
     }
 
-    //! Destructor definition needed to declare it throw()
-    ~ThrowStream() throw() { }
-
 
-    //! Add a new line to the backtrace
+    //! Get the first exception that was copied into this one and isn't a ThrowStream
     /*!
-     *  This returns ThrowStream & to allow using operator<<
+     *  This is only available if the exception was copied while it was being
+     *  handled (for example, with THROWSTREAMAPPEND in a catch block).
      *
-     *  \param[in] line The line on which the exception occurred
-     *  \param[in] file The file in which the exception occurred
-     *  \param[in] function function The function in which the exception occurred
+     *  \return The original exception, or null if there isn't one
      */
-    ThrowStream & Append(const unsigned long line, const string & file, const string & function)
+    std::exception_ptr Nested() const
     {
-        stringstream ss;
+        for(size_t i = 0; i < _frames.size(); i++)
+        {
+            if(_frames[i].nested)
+                return _frames[i].nested;
+        }
+        return std::exception_ptr();
+    }
 
-        ss << '\n';
 
-#ifdef THROWSTREAM_EXCEPTIONSOURCE
-        ss << "( " << file << ":" << line << " , in " << function << "() )    ->  ";
+#ifdef THROWSTREAM_EXCEPTIONS
+    //! Throw the original exception returned by Nested(), with its original type
+    /*!
+     *  Does nothing if there isn't one.
+     */
+    void RethrowNested() const
+    {
+        std::exception_ptr ptr = Nested();
+        if(ptr)
+            std::rethrow_exception(ptr);
+    }
+
+
+    //! Find an exception of a given type that was copied into this one
+    /*!
+     *  Searches all the original exceptions kept in this ThrowStream.
+     *
+     *  \code{.cpp}
+     *    if(const std::bad_alloc * ba = ts.FindNested<std::bad_alloc>())
+     *        ...
+     *  \endcode
+     *
+     *  \return Pointer to the exception (valid for the lifetime of this object), or null
+     */
+    template<typename T>
+    const T * FindNested() const
+    {
+        for(size_t i = 0; i < _frames.size(); i++)
+        {
+            if(!_frames[i].nested)
+                continue;
+
+            try
+            {
+                std::rethrow_exception(_frames[i].nested);
+            }
+            catch(const T & t)
+            {
+                return &t;
+            }
+            catch(...)
+            {
+            }
+        }
+        return nullptr;
+    }
 #endif
 
-        _desc.append(ss.str());
 
+    //! Attach exceptions collected from other tasks to the current entry
+    /*!
+     *  They are rendered below the current entry, with exceptions that have the
+     *  same callsite chain grouped together.
+     *
+     *  \param[in] children The exceptions to attach
+     */
+    ThrowStreamBasic & SetChildren(std::shared_ptr<const std::vector<ThrowStreamChild>> children)
+    {
+        _frames.back().children = std::move(children);
+        Invalidate();
+        return *this;
+    }
+
+
+    //! Attach an error code to the current entry
+    /*!
+     *  Only the value and a pointer to the category are stored, so this is cheap
+     *  and doesn't depend on the thread-safety of strerror(). The message is
+     *  looked up when the exception is rendered.
+     *
+     *  \param[in] ec The error code
+     */
+    ThrowStreamBasic & SetErrorCode(const std::error_code & ec)
+    {
+        Frame & f = _frames.back();
+        f.errorValue = ec.value();
+        f.errorCategory = &ec.category();
+        Invalidate();
         return *this;
     }
 
 
-    //! Add a new line to the backtrace, copying an existing exception
+    //! Add a part of the message that is formatted when the backtrace is rendered
     /*!
-     *  This returns ThrowStream & to allow using operator<<
+     *  It goes at the end of the current entry's message, as if added with the
+     *  stream operator. See THROWSTREAMVARS.
      *
-     *  \param[in] ex An exception to copy
-     *  \param[in] line The line on which the exception occurred
-     *  \param[in] file The file in which the exception occurred
-     *  \param[in] function function The function in which the exception occurred
+     *  \param[in] piece The part to add
      */
-    ThrowStream & Append(const exception & ex, const unsigned long line,
-                         const string & file, const string & function)
+    ThrowStreamBasic & AddDeferred(std::shared_ptr<const ThrowStreamDeferred> piece)
     {
-        //depends on if this is actually a throwstream
-        const ThrowStream * pts;
-        if((pts = dynamic_cast<const ThrowStream *>(&ex)))
+        Frame & f = _frames.back();
+        DeferredInsert d = { f.message.size(), std::move(piece) };
+        f.deferred.push_back(std::move(d));
+        Invalidate();
+        return *this;
+    }
+
+
+    //! Get the error code attached to this exception
+    /*!
+     *  If several entries have one, the oldest is returned, since that is
+     *  usually the original cause.
+     *
+     *  \return The error code, or an empty error_code if there isn't one
+     */
+    std::error_code ErrorCode() const
+    {
+        for(size_t i = 0; i < _frames.size(); i++)
         {
-            _desc.append(pts->_desc);
+            if(_frames[i].errorCategory != nullptr)
+                return _frames[i].ErrorCode();
         }
-        else
+        return std::error_code();
+    }
+
+
+    //! Write this exception in a compact binary form, for sending to another process
+    /*!
+     *  The entries, locations, messages, error codes, and aggregated exceptions are
+     *  kept, so the result of Deserialize can be appended to and thrown like the
+     *  original. Everything is written in a single pass, straight into \p buf.
+     *
+     *  Deferred parts of messages (see AddDeferred) are written as text, and exceptions
+     *  that aren't ThrowStreams as their description only. Error codes keep their
+     *  number, category name, and message. The error category (see THROWSTREAMCATEGORY)
+     *  is not kept.
+     *
+     *  Defined in ThrowStreamWire.h, which is only needed to call this (or Deserialize)
+     *  on ThrowStreamBasic with policies other than the defaults.
+     *
+     *  \code{.cpp}
+     *    std::vector<char> buf(256);
+     *    size_t n = ts.Serialize(buf.data(), buf.size());
+     *    if(n > buf.size())
+     *    {
+     *        buf.resize(n);
+     *        ts.Serialize(buf.data(), buf.size());
+     *    }
+     *  \endcode
+     *
+     *  \param[out] buf Where to write (may be null if \p size is 0)
+     *  \param[in] size Size of \p buf
+     *  \return The size of the whole serialized exception. If this is larger than
+     *          \p size, only the first \p size bytes were written.
+     */
+    size_t Serialize(void * buf, size_t size) const;
+
+
+    //! Rebuild an exception written by Serialize
+    /*!
+     *  File and function names are copied, and owned by the exception. Data that is
+     *  truncated, corrupted, or from a newer version of the format is rejected
+     *  by throwing a ThrowStream.
+     *
+     *  \param[in] buf The serialized exception
+     *  \param[in] size Size of \p buf (exactly what Serialize returned)
+     */
+    static ThrowStreamBasic Deserialize(const void * buf, size_t size);
+
+
+    //! Pass each piece of the rendered backtrace to a function, in order
+    /*!
+     *  This produces the same text as what(), but without joining it into one string.
+     *  Pieces longer than ThrowStreamTemporarySegment point into this object (or into
+     *  static storage) and stay valid while it is unchanged. Shorter ones may be
+     *  temporary (line numbers, messages of error codes, values formatted when
+     *  rendering), so \p data is only valid until \p fn returns.
+     *
+     *  \param[in] fn Function to call with each piece
+     *  \param[in] ctx Passed to \p fn unchanged
+     *  \param[in] safe If true, skip anything that may allocate (the messages of
+     *                  error codes), for rendering from a signal handler
+     */
+    void VisitSegments(SegmentFn fn, void * ctx, bool safe = false) const;
+
+
+    //! Pass each piece of the rendered backtrace to a callable, in order
+    /*!
+     *  \p f is called as f(const char * data, size_t size). See VisitSegments().
+     */
+    template<typename F>
+    void ForEachSegment(F && f, bool safe = false) const
+    {
+        typedef typename std::remove_reference<F>::type Fn;
+        struct Call
+        {
+            static void Segment(void * ctx, const char * data, size_t size)
+            {
+                (*static_cast<Fn *>(ctx))(data, size);
+            }
+        };
+        VisitSegments(&Call::Segment, const_cast<void *>(static_cast<const void *>(&f)), safe);
+    }
+
+
+    //! Category of a plain ThrowStream (none). See THROWSTREAMCATEGORY
+    static const ThrowStreamCategoryInfo * Category()
+    {
+        return nullptr;
+    }
+
+
+    //! Get the error category of this exception (null if none)
+    /*!
+     *  The category is kept when the exception is appended to a plain ThrowStream
+     *  (for example, with THROWSTREAMAPPEND), even though the type is not.
+     */
+    const ThrowStreamCategoryInfo * CategoryInfo() const
+    {
+        return _category;
+    }
+
+
+    //! Does this exception belong to a category (or one derived from it)?
+    /*!
+     *  Only compares pointers, so this is cheap to use at a catch site.
+     *
+     *  \code{.cpp}
+     *    catch(const ThrowStream & ts)
+     *    {
+     *        if(ts.IsCategory<IoError>())
+     *            ...
+     *    }
+     *  \endcode
+     */
+    template<typename C>
+    bool IsCategory() const
+    {
+        const ThrowStreamCategoryInfo * target = C::Category();
+        for(const ThrowStreamCategoryInfo * c = _category; c != nullptr; c = c->parent)
         {
-            //will end up a double append, but oh well, it's the
-            //best I can do with only an exception
-            Append(line,file,function) << ex.what();
+            if(c == target)
+                return true;
         }
+        return false;
+    }
 
-        Append(line,file,function);
 
-        return *this;
+    //! Set the error category. Used by classes created with THROWSTREAMCATEGORY
+    void SetCategory(const ThrowStreamCategoryInfo * category)
+    {
+        _category = category;
+    }
+
+
+    //! A 64-bit hash of the callsite chain, for grouping identical failures
+    /*!
+     *  Only the file and function of each entry are used, not the messages, so
+     *  the same failure path gives the same fingerprint whatever values were
+     *  involved. It is kept up to date as entries are added, so this costs nothing.
+     *
+     *  The fingerprint is the same from run to run, and survives Serialize. Line
+     *  numbers are left out so that it also stays the same when unrelated code
+     *  moves; define THROWSTREAM_FINGERPRINT_LINE (everywhere) to include them.
+     *  File names are used as given, so set THROWSTREAM_SOURCE_ROOT for
+     *  fingerprints that don't depend on where the source was built.
+     *
+     *  \code{.cpp}
+     *    catch(const ThrowStream & ts)
+     *    {
+     *        if(seen.insert(ts.Fingerprint()).second)
+     *            Log(ts.what());
+     *    }
+     *  \endcode
+     */
+    uint64_t Fingerprint() const
+    {
+        return _fingerprint;
+    }
+
+
+    //! Get the entries of the backtrace, oldest first
+    const std::vector<Frame> & Frames() const
+    {
+        return _frames;
     }
 
 
@@ -127,10 +1263,7 @@ public:
      *
      *  \return An array of characters representing the backtrace
      */
-    char const* what() const throw()
-    {
-        return _desc.c_str();
-    }
+    char const* what() const throw();
 
 
     //! Add information to the current entry in the backtrace
@@ -140,85 +1273,197 @@ public:
         \return The modified ThrowStream object
      */
     template<typename T>
-    ThrowStream & operator<<(const T & rhs)
+    ThrowStreamBasic & operator<<(const T & rhs);
+
+
+    // The most common types are added by plain functions rather than the template,
+    // so there is one copy of each (see THROWSTREAM_IMPLEMENTATION) rather than one
+    // in every file. String literals of any length use the const char * version.
+    ThrowStreamBasic & operator<<(const char * rhs);
+    ThrowStreamBasic & operator<<(const string & rhs);
+    ThrowStreamBasic & operator<<(char rhs);
+    ThrowStreamBasic & operator<<(bool rhs);
+    ThrowStreamBasic & operator<<(int rhs);
+    ThrowStreamBasic & operator<<(unsigned int rhs);
+    ThrowStreamBasic & operator<<(long rhs);
+    ThrowStreamBasic & operator<<(unsigned long rhs);
+    ThrowStreamBasic & operator<<(long long rhs);
+    ThrowStreamBasic & operator<<(unsigned long long rhs);
+    ThrowStreamBasic & operator<<(double rhs);
+
+
+    //! Add a part of the message that is formatted when rendering (see AddDeferred)
+    ThrowStreamBasic & operator<<(const ThrowStreamDeferredRef & rhs)
     {
-        stringstream ss;
-        ss << rhs;
-        _desc.append(ss.str());
-        return *this;
+        return AddDeferred(rhs.piece);
     }
 };
 
 
-//! Create a THROWSTREAM object representing an exception at this location, and throw it
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+template<typename T>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(const T & rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+// ThrowStream (including the stream operator for common types) is compiled once, in
+// the library or the file defining THROWSTREAM_IMPLEMENTATION, rather than in every
+// file that uses it
+extern template class ThrowStreamBasic<ThrowStreamStringStorage, ThrowStreamStreamFormat, ThrowStreamTextRender>;
+
+
+//! Thrown by the THROWSTREAM macros in place of a ThrowStream once work has been cancelled
 /*!
- *  This is used primarily to throw the first exception. To add a description:
- *
- *  \code{.cpp}
- *    THROWSTREAM << "Some description: " << somevar;
- *  \endcode
+ *  Nothing is formatted for this exception. See ThrowStreamCancel.h
  */
-#define THROWSTREAM throw ThrowStream(__LINE__, __FILE__, __FUNCTION__)
+class ThrowStreamCancelled : public exception
+{
+public:
+    char const* what() const throw()
+    {
+        return "Cancelled due to an earlier error";
+    }
+};
 
 
-//! Copy information from another exception, and then throw the exception
+//! The cancellation flag for the work running on this thread (null if none)
 /*!
- *  The exception to copied can be an std::exception or any derivative of std::exception
- *
- *  \code{.cpp}
- *    THROWSTREAMAPPEND(somex) << "Called from here: somevar = " << somevar;
- *  \endcode
+ *  This is set by ThrowStreamCancelScope (see ThrowStreamCancel.h)
  */
-#define THROWSTREAMAPPEND(ex) throw ThrowStream( (ex), __LINE__, __FILE__, __FUNCTION__)
+inline const std::atomic<bool> *& ThrowStreamCancelFlag()
+{
+    static thread_local const std::atomic<bool> * flag = nullptr;
+    return flag;
+}
+
 
+//! Has the work running on this thread been cancelled?
+inline bool ThrowStreamIsCancelled()
+{
+    const std::atomic<bool> * flag = ThrowStreamCancelFlag();
+    return flag != nullptr && flag->load(std::memory_order_relaxed);
+}
 
-//! Creates a ThrowStream object with a specified name with the current location added
+
+//! Throw a ThrowStreamCancelled if the work running on this thread has been cancelled
 /*!
- *  This is to allow appending to it later (see THROWSTREAMOBJAPPEND). This does not
- *  actually throw the exception
- *
- *  \code{.cpp}
- *    THROWSTREAMOBJ(myex) << "Called from here: somevar = " << somevar;
- *  \endcode
- *
- *  \param ex The name of the object to create
+ *  This is called by the throwing macros before anything is formatted, so every
+ *  THROWSTREAM costs one extra thread_local load (a call to __tls_get_addr in
+ *  position-independent code). This is only on the path that throws, and
+ *  nothing is added to code that doesn't.
  */
-#define THROWSTREAMOBJ(ex) ThrowStream (ex)(__LINE__, __FILE__, __FUNCTION__); (ex)
+inline void ThrowStreamCheckCancelled()
+{
+#ifdef THROWSTREAM_EXCEPTIONS
+    if(ThrowStreamIsCancelled())
+        throw ThrowStreamCancelled();
+#endif
+}
 
 
-//! Add information to an already-named ThrowStream object
+//! Throw a ThrowStream (or a class derived from it)
 /*!
- *  Adds location information. This does not throw the exception.
+ *  Use this in place of a throw expression in code that should also build
+ *  without exceptions. In that case, the failure handler is called instead
+ *  (see ThrowStreamNoExcept.h), with a copy as a ThrowStream if \p ts uses
+ *  other policies.
  *
  *  \code{.cpp}
- *    THROWSTREAMOBJAPPEND(myex) << "Called from here: somevar = " << somevar;
+ *    if(error)
+ *        ThrowStreamRaise(ts);
  *  \endcode
  *
- *  \param ex The name of the object to append to
+ *  \param[in] ts The exception to throw
  */
-#define THROWSTREAMOBJAPPEND(ex) (ex).Append(__LINE__, __FILE__, __FUNCTION__)
+template<typename T>
+[[noreturn]] void ThrowStreamRaise(const T & ts);
 
 
-//! Copy a ThrowStream object into an already-created object, and add the current location.
-/*!
- *  Adds location information as well. This does not throw the exception.
- *  The exception to copy can be an std::exception or any derivative of std::exception
- *
- *  \param ex The object to append to
- *  \param ey The exception to be appended
- */
-#define THROWSTREAMOBJAPPENDCOPY(ex,ey) ex.Append((ey), __LINE__, __FILE__, __FUNCTION__)
+#ifdef THROWSTREAM_EXCEPTIONS
+template<typename T>
+[[noreturn]] void ThrowStreamRaise(const T & ts)
+{
+    throw ts;
+}
+#endif
 
 
-//! Creates a ThrowStream object based on another exception.
+//! The current value of errno, as an std::error_code (used by THROWSTREAMERRNO)
+inline std::error_code ThrowStreamErrnoCode()
+{
+    return std::error_code(errno, std::generic_category());
+}
+
+
+//! Base for exception classes created with THROWSTREAMCATEGORY
 /*!
- *  Adds location information as well. This does not throw the exception.
- *  The exception to copy can be an std::exception or any derivative of std::exception
+ *  Sets the category when constructed, and makes the stream operator return
+ *  the derived type so that THROWSTREAMAS throws the right type.
  *
- *  \param ex The name of the object to create
- *  \param ey The exception object to copy
+ *  \tparam Derived The category class being defined
+ *  \tparam Base The parent category class (or ThrowStream)
  */
-#define THROWSTREAMOBJCOPY(ex,ey) ThrowStream (ex)((ey),__LINE__, __FILE__, __FUNCTION__ ); (ex)
+template<typename Derived, typename Base>
+class ThrowStreamCategoryBase : public Base
+{
+public:
+    //! Construct using a location
+    explicit ThrowStreamCategoryBase(const ThrowStreamLocation & loc)
+        : Base(loc)
+    {
+        this->SetCategory(Derived::Category());
+    }
+
+    //! Construct by copying an exception and adding a new location
+    ThrowStreamCategoryBase(const exception & ex, const ThrowStreamLocation & loc)
+        : Base(ex, loc)
+    {
+        this->SetCategory(Derived::Category());
+    }
+
+    //! Construct by copying a ThrowStream and adding a new location
+    ThrowStreamCategoryBase(const ThrowStream & ts, const ThrowStreamLocation & loc)
+        : Base(ts, loc)
+    {
+        this->SetCategory(Derived::Category());
+    }
+
+    //! Construct using the line, file, and function
+    ThrowStreamCategoryBase(const unsigned long line, const string & file, const string & function)
+        : Base(line, file, function)
+    {
+        this->SetCategory(Derived::Category());
+    }
+
+    //! Construct by copying an exception and adding a new line, file, and function
+    ThrowStreamCategoryBase(const exception & ex, const unsigned long line,
+                            const string & file, const string & function)
+        : Base(ex, line, file, function)
+    {
+        this->SetCategory(Derived::Category());
+    }
+
+    //! Construct by copying a ThrowStream and adding a new line, file, and function
+    ThrowStreamCategoryBase(const ThrowStream & ts, const unsigned long line,
+                            const string & file, const string & function)
+        : Base(ts, line, file, function)
+    {
+        this->SetCategory(Derived::Category());
+    }
+
+    //! Add information to the current entry in the backtrace
+    template<typename T>
+    Derived & operator<<(const T & rhs)
+    {
+        ThrowStream::operator<<(rhs);
+        return static_cast<Derived &>(*this);
+    }
+};
 
 
 //! Allow output to an ostream using the stream operator
@@ -227,11 +1472,43 @@ public:
     \param[in] ts A throwstream object to output
     \return The ostream object again
  */
-inline ostream & operator<<(ostream & os, const ThrowStream & ts)
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ostream & operator<<(ostream & os, const ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> & ts)
+{
+    ts.ForEachSegment([&os](const char * data, size_t size) { os.write(data, size); });
+    return os;
+}
+
+
+//! Write a deferred part of a message to an ostream straight away
+/*!
+    \param[in,out] os An ostream object to output to
+    \param[in] d The part to write
+    \return The ostream object again
+ */
+inline ostream & operator<<(ostream & os, const ThrowStreamDeferredRef & d)
 {
-    os << ts._desc;
+    struct Write
+    {
+        static void Segment(void * ctx, const char * data, size_t size)
+        {
+            static_cast<ostream *>(ctx)->write(data, size);
+        }
+    };
+    d.piece->Visit(&Write::Segment, &os, false);
     return os;
 }
 
+#ifndef THROWSTREAM_EXCEPTIONS
+#include "ThrowStreamNoExcept.h"
+#endif
+
+#ifdef THROWSTREAM_IMPLEMENTATION_FILE
+#include "ThrowStreamImpl.h"
+#include "ThrowStreamWire.h"
+
+template class ThrowStreamBasic<ThrowStreamStringStorage, ThrowStreamStreamFormat, ThrowStreamTextRender>;
+#endif
+
 #endif //BPLIB_THROWSTREAM_H
 
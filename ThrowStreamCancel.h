@@ -0,0 +1,171 @@
+/*! \file
+ *  \brief     Stop parallel work once the first ThrowStream is thrown
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#ifndef BPLIB_THROWSTREAMCANCEL_H
+#define BPLIB_THROWSTREAMCANCEL_H
+
+#include <atomic>
+#include <exception>
+#include "ThrowStream.h"
+
+
+//! Shared between the workers of a parallel job. The first error cancels the rest
+/*!
+ *  Once an error is published, THROWSTREAM and THROWSTREAMAPPEND on any thread
+ *  running under a ThrowStreamCancelScope for this token throw a ThrowStreamCancelled
+ *  without formatting anything. Long loops can also check IsCancelled() (or
+ *  ThrowStreamIsCancelled()) to stop early.
+ *
+ *  \code{.cpp}
+ *    ThrowStreamCancelToken token;
+ *    // on each worker:
+ *    token.Run([&]{ ProcessChunk(i); });
+ *
+ *    // after the workers are joined:
+ *    token.RethrowFirst();
+ *  \endcode
+ */
+class ThrowStreamCancelToken
+{
+private:
+    std::atomic<bool> _cancelled; //!< Checked by the workers
+    std::atomic<bool> _claimed;   //!< Set by the first thread to publish an error
+    std::exception_ptr _first;    //!< The first error published
+
+public:
+    ThrowStreamCancelToken() : _cancelled(false), _claimed(false) { }
+
+    ThrowStreamCancelToken(const ThrowStreamCancelToken &) = delete;
+    ThrowStreamCancelToken & operator=(const ThrowStreamCancelToken &) = delete;
+
+
+    //! The flag that is checked by the workers
+    const std::atomic<bool> & Flag() const
+    {
+        return _cancelled;
+    }
+
+
+    //! Has the work been cancelled? Cheap enough to check in an inner loop
+    bool IsCancelled() const
+    {
+        return _cancelled.load(std::memory_order_relaxed);
+    }
+
+
+    //! Cancel the work without an error
+    void Cancel()
+    {
+        _cancelled.store(true, std::memory_order_release);
+    }
+
+
+    //! Publish an error, cancelling the work
+    /*!
+     *  Only the first error is kept. Later ones are ignored.
+     *
+     *  \param[in] ptr The error to publish
+     *  \return True if this was the first error
+     */
+    bool Publish(std::exception_ptr ptr)
+    {
+        bool expected = false;
+        if(!_claimed.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+            return false;
+
+        _first = ptr;
+        Cancel();
+        return true;
+    }
+
+
+    //! Get the first error published (null if none)
+    /*!
+     *  This should only be called once the workers are finished.
+     */
+    std::exception_ptr FirstError() const
+    {
+        return _claimed.load(std::memory_order_acquire) ? _first : std::exception_ptr();
+    }
+
+
+    //! Rethrow the first error published, if there was one
+    /*!
+     *  This should only be called once the workers are finished.
+     */
+    void RethrowFirst() const
+    {
+        std::exception_ptr ptr = FirstError();
+        if(ptr)
+            std::rethrow_exception(ptr);
+    }
+
+
+    //! Run a piece of work under this token
+    /*!
+     *  The work runs inside a ThrowStreamCancelScope. If it throws, the exception
+     *  is published (and not rethrown). Work that has already been cancelled
+     *  is not started.
+     *
+     *  \param[in] f The work to run
+     *  \return True if the work ran to completion
+     */
+    template<typename F>
+    bool Run(F && f);
+};
+
+
+//! Make the THROWSTREAM macros on this thread check a token
+/*!
+ *  The previous token (if any) is restored when this is destroyed.
+ */
+class ThrowStreamCancelScope
+{
+private:
+    const std::atomic<bool> * _previous; //!< Flag in use before this scope
+
+public:
+    explicit ThrowStreamCancelScope(const ThrowStreamCancelToken & token)
+        : _previous(ThrowStreamCancelFlag())
+    {
+        ThrowStreamCancelFlag() = &token.Flag();
+    }
+
+    ~ThrowStreamCancelScope()
+    {
+        ThrowStreamCancelFlag() = _previous;
+    }
+
+    ThrowStreamCancelScope(const ThrowStreamCancelScope &) = delete;
+    ThrowStreamCancelScope & operator=(const ThrowStreamCancelScope &) = delete;
+};
+
+
+template<typename F>
+bool ThrowStreamCancelToken::Run(F && f)
+{
+    if(IsCancelled())
+        return false;
+
+    ThrowStreamCancelScope scope(*this);
+
+    try
+    {
+        f();
+        return true;
+    }
+    catch(const ThrowStreamCancelled &)
+    {
+    }
+    catch(...)
+    {
+        Publish(std::current_exception());
+    }
+
+    return false;
+}
+
+#endif //BPLIB_THROWSTREAMCANCEL_H
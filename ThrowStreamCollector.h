@@ -0,0 +1,257 @@
+/*! \file
+ *  \brief     Collect ThrowStream entries from many threads at once
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#ifndef BPLIB_THROWSTREAMCOLLECTOR_H
+#define BPLIB_THROWSTREAMCOLLECTOR_H
+
+#include <atomic>
+#include <string>
+#include <sstream>
+#include "ThrowStream.h"
+
+
+class ThrowStreamCollector;
+
+
+//! A single entry being added to a ThrowStreamCollector
+/*!
+ *  Information is added with the stream operator, just like a ThrowStream. The
+ *  entry is published to the collector when this object is destroyed, which
+ *  for THROWSTREAMCOLLECT is at the end of the statement.
+ */
+class ThrowStreamCollectorEntry
+{
+private:
+    ThrowStreamCollector * _collector; //!< Collector to publish to (null once published or moved)
+    unsigned long _seq;    //!< Sequence number of this entry
+    unsigned long _line;   //!< The line the entry was created on
+    const char * _file;    //!< The file the entry was created in
+    const char * _function;//!< The function the entry was created in
+    string _message;       //!< Information added so far
+
+public:
+    //! Start a new entry (see ThrowStreamCollector::Add)
+    ThrowStreamCollectorEntry(ThrowStreamCollector & collector, unsigned long seq,
+                              unsigned long line, const char * file, const char * function)
+        : _collector(&collector), _seq(seq), _line(line), _file(file), _function(function)
+    { }
+
+    //! Move an unpublished entry. The moved-from entry will not be published.
+    ThrowStreamCollectorEntry(ThrowStreamCollectorEntry && rhs)
+        : _collector(rhs._collector), _seq(rhs._seq), _line(rhs._line),
+          _file(rhs._file), _function(rhs._function), _message(std::move(rhs._message))
+    {
+        rhs._collector = nullptr;
+    }
+
+    ThrowStreamCollectorEntry(const ThrowStreamCollectorEntry &) = delete;
+    ThrowStreamCollectorEntry & operator=(const ThrowStreamCollectorEntry &) = delete;
+
+    //! Publishes the entry to the collector
+    inline ~ThrowStreamCollectorEntry();
+
+
+    //! Add information to the entry
+    /*!
+        \param[in] rhs Data to add. This must be able to be inserted into
+                       a stringstream object.
+        \return This entry
+     */
+    template<typename T>
+    ThrowStreamCollectorEntry & operator<<(const T & rhs)
+    {
+        stringstream ss;
+        ss << rhs;
+        _message.append(ss.str());
+        return *this;
+    }
+};
+
+
+//! Collects backtrace entries from many threads, to be thrown later as one ThrowStream
+/*!
+ *  This is the multithreaded counterpart to the THROWSTREAMOBJ/THROWSTREAMOBJAPPEND pattern.
+ *  Any number of threads may add entries at the same time without locking. Each entry
+ *  gets a sequence number when it is started, and entries are stored in a list of
+ *  fixed-size segments indexed by that number. Once all the threads are finished,
+ *  MergeInto() appends the entries to a regular ThrowStream in sequence order.
+ *
+ *  \code{.cpp}
+ *    ThrowStreamCollector errors;
+ *    // on many threads:
+ *    if(row.bad())
+ *        THROWSTREAMCOLLECT(errors) << "Bad row " << i;
+ *
+ *    // after the threads are joined:
+ *    if(!errors.Empty())
+ *    {
+ *        THROWSTREAMOBJ(ts) << "Validation failed";
+ *        errors.MergeInto(ts);
+ *        throw ts;
+ *    }
+ *  \endcode
+ */
+class ThrowStreamCollector
+{
+private:
+    friend class ThrowStreamCollectorEntry;
+
+    static const unsigned long SegmentSize = 64; //!< Number of entries in each segment
+
+    //! Storage for a single published entry
+    struct Slot
+    {
+        unsigned long line;
+        const char * file;
+        const char * function;
+        string message;
+        std::atomic<bool> ready; //!< Set once the entry has been written
+
+        Slot() : ready(false) { }
+    };
+
+    //! A block of slots. Segments are only ever added to the end of the list.
+    struct Segment
+    {
+        unsigned long base; //!< Sequence number of the first slot
+        Slot slots[SegmentSize];
+        std::atomic<Segment *> next;
+
+        explicit Segment(unsigned long b) : base(b), next(nullptr) { }
+    };
+
+    std::atomic<unsigned long> _count; //!< Number of entries started
+    Segment _first;                    //!< The first segment, so small collections never allocate
+    std::atomic<Segment *> _last;      //!< The last segment known to exist (a hint only)
+
+
+    //! Find (creating segments as needed) the slot for a sequence number
+    Slot & GetSlot(unsigned long seq)
+    {
+        Segment * seg = _last.load(std::memory_order_acquire);
+        if(seg->base > seq)
+            seg = &_first;
+
+        while(seq >= seg->base + SegmentSize)
+        {
+            Segment * next = seg->next.load(std::memory_order_acquire);
+            if(next == nullptr)
+            {
+                Segment * created = new Segment(seg->base + SegmentSize);
+                if(seg->next.compare_exchange_strong(next, created, std::memory_order_acq_rel))
+                    next = created;
+                else
+                    delete created; // another thread got there first. next is now its segment
+            }
+
+            Segment * expected = seg;
+            _last.compare_exchange_strong(expected, next, std::memory_order_acq_rel);
+            seg = next;
+        }
+
+        return seg->slots[seq - seg->base];
+    }
+
+
+    //! Store a finished entry
+    void Publish(unsigned long seq, unsigned long line, const char * file,
+                 const char * function, string && message)
+    {
+        Slot & slot = GetSlot(seq);
+        slot.line = line;
+        slot.file = file;
+        slot.function = function;
+        slot.message = std::move(message);
+        slot.ready.store(true, std::memory_order_release);
+    }
+
+
+public:
+    ThrowStreamCollector() : _count(0), _first(0), _last(&_first) { }
+
+    ThrowStreamCollector(const ThrowStreamCollector &) = delete;
+    ThrowStreamCollector & operator=(const ThrowStreamCollector &) = delete;
+
+    ~ThrowStreamCollector()
+    {
+        Segment * seg = _first.next.load(std::memory_order_acquire);
+        while(seg != nullptr)
+        {
+            Segment * next = seg->next.load(std::memory_order_acquire);
+            delete seg;
+            seg = next;
+        }
+    }
+
+
+    //! Start a new entry. Usually called through THROWSTREAMCOLLECT
+    /*!
+     *  Safe to call from any number of threads at once.
+     *
+     *  \param[in] line The line on which the error occurred
+     *  \param[in] file The file in which the error occurred
+     *  \param[in] function The function in which the error occurred
+     */
+    ThrowStreamCollectorEntry Add(unsigned long line, const char * file, const char * function)
+    {
+        unsigned long seq = _count.fetch_add(1, std::memory_order_relaxed);
+        return ThrowStreamCollectorEntry(*this, seq, line, file, function);
+    }
+
+
+    //! Number of entries that have been started
+    unsigned long Size() const
+    {
+        return _count.load(std::memory_order_acquire);
+    }
+
+
+    //! Have any entries been added?
+    bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+
+    //! Append all entries to a ThrowStream, in sequence order
+    /*!
+     *  This should only be called once the threads adding entries are finished.
+     *  Entries still being written are skipped.
+     *
+     *  \param[in,out] ts The ThrowStream to append to
+     *  \return \p ts
+     */
+    ThrowStream & MergeInto(ThrowStream & ts) const
+    {
+        unsigned long count = Size();
+        const Segment * seg = &_first;
+
+        for(unsigned long seq = 0; seq < count && seg != nullptr; seq++)
+        {
+            if(seq >= seg->base + SegmentSize)
+            {
+                seg = seg->next.load(std::memory_order_acquire);
+                if(seg == nullptr)
+                    break;
+            }
+
+            const Slot & slot = seg->slots[seq - seg->base];
+            if(slot.ready.load(std::memory_order_acquire))
+                ts.Append(ThrowStreamLocation(slot.line, slot.file, slot.function)) << slot.message;
+        }
+
+        return ts;
+    }
+};
+
+
+inline ThrowStreamCollectorEntry::~ThrowStreamCollectorEntry()
+{
+    if(_collector != nullptr)
+        _collector->Publish(_seq, _line, _file, _function, std::move(_message));
+}
+
+#endif //BPLIB_THROWSTREAMCOLLECTOR_H
@@ -0,0 +1,371 @@
+/*! \file
+ *  \brief     Log exceptions from a background thread, writing repeated ones only once
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#ifndef BPLIB_THROWSTREAMDEDUPSINK_H
+#define BPLIB_THROWSTREAMDEDUPSINK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "ThrowStream.h"
+#include "ThrowStreamSink.h"
+
+
+//! A ThrowStreamSink that writes each failure once, then counts the repeats
+/*!
+ *  Exceptions are grouped by ThrowStream::Fingerprint. The first of each group
+ *  is written in full (through a ThrowStreamSink). Repeats are only counted, and a
+ *  summary line is written for each group at the end of every time window:
+ *
+ *  \code{.unparsed}
+ *    ( input.cpp , in Parse() )    ->  Seen 48213 more times in the last 10s
+ *  \endcode
+ *
+ *  A group that isn't seen for a whole window is forgotten, so the next one is
+ *  written in full again. Its place in the table is then reused.
+ *
+ *  Submitting a repeat costs a lookup in a lock-free table and an atomic increment.
+ *  Nothing is copied or rendered. Exceptions that aren't ThrowStreams are always written.
+ *
+ *  \code{.cpp}
+ *    ThrowStreamDedupSink sink(std::cerr);
+ *    ...
+ *    catch(const ThrowStream & ts)
+ *    {
+ *        sink.Submit(ts);
+ *    }
+ *  \endcode
+ */
+class ThrowStreamDedupSink
+{
+private:
+    //! Number of places tried when looking up a fingerprint
+    static const size_t MaxProbes = 64;
+
+    //! Key of an entry whose group was forgotten, which can be reused
+    /*!
+     *  Unlike clearing the key to 0, this keeps the entries after it reachable
+     *  by the fingerprints that were placed past it.
+     */
+    static const uint64_t Forgotten = ~uint64_t(0);
+
+    // Flags in Entry::state, above the number of repeats
+    static const uint64_t Fresh = uint64_t(1) << 62;  //!< Written in full since the last summary
+    static const uint64_t Dead = uint64_t(1) << 63;   //!< Being forgotten. Anything added now is ignored
+    static const uint64_t RepeatMask = Fresh - 1;     //!< The number of repeats
+
+    //! Counts for one fingerprint
+    struct Entry
+    {
+        std::atomic<uint64_t> key{0};       //!< The fingerprint (0 if never used, or Forgotten)
+        std::atomic<bool> active{false};    //!< Written in full, and seen since the last window
+
+        //! Repeats since the last summary, and the Fresh and Dead flags
+        /*!
+         *  Kept in one word, so that a repeat is either added before the group is
+         *  forgotten (and counted), or sees that it was.
+         */
+        std::atomic<uint64_t> state{0};
+
+        // For the summary, protected by _locationMutex
+        const char * file = "?";             //!< Where the exception was thrown
+        const char * function = "?";         //!< Function it was thrown in
+        bool signature = true;               //!< True if \p function includes the arguments
+        std::shared_ptr<const string> names; //!< Keeps \p file and \p function if they were copied
+    };
+
+    const size_t _mask;                      //!< Table size - 1 (the size is a power of two)
+    std::unique_ptr<Entry[]> _entries;       //!< The table, using linear probing. Ready before \p _sink starts
+    std::mutex _locationMutex;               //!< Protects the locations in \p _entries
+
+    const std::chrono::steady_clock::duration _window; //!< Time between summaries
+    string _windowText;                                 //!< The window, as written in summaries
+    std::chrono::steady_clock::time_point _last;        //!< Time of the last summary (background thread only)
+
+    ThrowStreamSink _sink; //!< Writes the first of each group, and the summaries. Destroyed first
+
+
+    //! Round up to a power of two
+    static size_t Capacity(size_t requested)
+    {
+        size_t c = 2;
+        while(c < requested)
+            c <<= 1;
+        return c;
+    }
+
+
+    //! Find the entry for a fingerprint, adding it if needed
+    /*!
+     *  A new fingerprint takes the first forgotten entry on its way, if any,
+     *  otherwise the first unused one.
+     *
+     *  \return The entry, or null if the table is too full
+     */
+    Entry * Find(uint64_t key)
+    {
+        for(;;)
+        {
+            Entry * forgotten = nullptr;
+            size_t i = size_t(key) & _mask;
+            for(size_t n = 0; n < MaxProbes && n <= _mask; n++, i = (i + 1) & _mask)
+            {
+                Entry & e = _entries[i];
+                uint64_t k = e.key.load(std::memory_order_acquire);
+                if(k == key)
+                    return &e;
+                if(k == Forgotten && forgotten == nullptr)
+                    forgotten = &e;
+                if(k != 0)
+                    continue;
+
+                // Nothing past here, so the fingerprint is new
+                if(forgotten != nullptr)
+                    break;
+                if(e.key.compare_exchange_strong(k, key, std::memory_order_acq_rel))
+                    return &e;
+                if(k == key) // just added by another thread
+                    return &e;
+            }
+
+            if(forgotten == nullptr)
+                return nullptr;
+
+            uint64_t k = Forgotten;
+            if(forgotten->key.compare_exchange_strong(k, key, std::memory_order_acq_rel))
+            {
+                // Left over from the group it was used for
+                forgotten->active.store(false, std::memory_order_release);
+                forgotten->state.store(0, std::memory_order_release);
+                return forgotten;
+            }
+            if(k == key)
+                return forgotten;
+
+            // Taken by another fingerprint. Look again
+        }
+    }
+
+
+    //! Count an exception. Returns true if it should be written in full
+    /*!
+     *  \param[in] ts The exception
+     *  \param[out] first Set to the entry this made active (null if none), for Unrecord
+     */
+    bool Record(const ThrowStream & ts, Entry *& first)
+    {
+        first = nullptr;
+
+        uint64_t key = ts.Fingerprint();
+        if(key == 0 || key == Forgotten)
+            key = 1;
+
+        for(;; std::this_thread::yield())
+        {
+            Entry * e = Find(key);
+            if(e == nullptr)
+                return true;
+
+            bool full = false;
+            if(!e->active.load(std::memory_order_acquire))
+            {
+                // Stored before setting active, so anyone adding a repeat sees them
+                const ThrowStream::Frame * frame = nullptr;
+                for(size_t i = 0; i < ts.Frames().size() && frame == nullptr; i++)
+                {
+                    if(!ts.Frames()[i].external)
+                        frame = &ts.Frames()[i];
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(_locationMutex);
+                    e->file = (frame != nullptr) ? frame->file : "?";
+                    e->function = (frame != nullptr) ? frame->function : "?";
+                    e->signature = (frame != nullptr) ? frame->signature : true;
+                    e->names = (frame != nullptr) ? frame->names : std::shared_ptr<const string>();
+                }
+
+                full = !e->active.exchange(true, std::memory_order_acq_rel);
+            }
+
+            const uint64_t old = full ? e->state.fetch_or(Fresh, std::memory_order_acq_rel)
+                                      : e->state.fetch_add(1, std::memory_order_acq_rel);
+
+            // The group was forgotten (and maybe its entry reused) since it was found. Start again.
+            // If the entry was already reused when the repeat was added, it was also counted for
+            // the new group. Stalling here across a single summary is enough for that
+            if((old & Dead) != 0 || e->key.load(std::memory_order_acquire) != key)
+            {
+                if(full)
+                    e->active.store(false, std::memory_order_release);
+                continue;
+            }
+
+            if(full)
+                first = e;
+            return full;
+        }
+    }
+
+
+    //! Undo Record after the first of a group was dropped, so the next one is written in full
+    void Unrecord(Entry * first)
+    {
+        if(first != nullptr)
+            first->active.store(false, std::memory_order_release);
+    }
+
+
+    //! Write a summary of the repeats, once per window (called by the sink's background thread)
+    void Summarize(ostream & os, bool final)
+    {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(!final && now - _last < _window)
+            return;
+        _last = now;
+
+        bool written = false;
+        for(size_t i = 0; i <= _mask; i++)
+        {
+            Entry & e = _entries[i];
+            const uint64_t key = e.key.load(std::memory_order_acquire);
+            if(key == 0 || key == Forgotten)
+                continue;
+
+            // Take the repeats, or mark the group Dead if it was quiet for a whole window
+            uint64_t s = e.state.load(std::memory_order_relaxed);
+            while((s & Dead) == 0 &&
+                  !e.state.compare_exchange_weak(s, (s == 0) ? Dead : 0, std::memory_order_acq_rel))
+            { }
+
+            if((s & Dead) != 0) // being reused
+                continue;
+
+            if(s == 0)
+            {
+                // Whoever reuses the entry resets the rest
+                e.key.store(Forgotten, std::memory_order_release);
+                std::lock_guard<std::mutex> lock(_locationMutex);
+                e.names.reset();
+                continue;
+            }
+
+            const unsigned long n = (unsigned long)(s & RepeatMask);
+            if(n == 0)
+                continue;
+
+            const char * file;
+            const char * function;
+            bool signature;
+            std::shared_ptr<const string> names;
+            {
+                std::lock_guard<std::mutex> lock(_locationMutex);
+                file = e.file;
+                function = e.function;
+                signature = e.signature;
+                names = e.names;
+            }
+
+            os << "( " << file << " , in " << function << (signature ? " )" : "() )")
+               << "    ->  Seen " << n << " more time" << (n == 1 ? "" : "s")
+               << " in the last " << _windowText << '\n';
+            written = true;
+        }
+
+        if(written)
+            os.flush();
+    }
+
+
+public:
+    //! Start the background thread
+    /*!
+     *  \param[in] os Where the exceptions are written. Only the background thread uses it
+     *  \param[in] window How often summaries are written
+     *  \param[in] tableSize Number of different fingerprints that can be counted at once (rounded
+     *                       up to a power of two). Beyond that, new ones are always written in full
+     *  \param[in] capacity Number of exceptions the queue can hold (see ThrowStreamSink)
+     *  \param[in] policy What to do when the queue is full (see ThrowStreamSink)
+     */
+    explicit ThrowStreamDedupSink(ostream & os,
+                                  std::chrono::milliseconds window = std::chrono::seconds(10),
+                                  size_t tableSize = 4096, size_t capacity = 1024,
+                                  ThrowStreamSink::OverflowPolicy policy = ThrowStreamSink::Drop)
+        : _mask(Capacity(tableSize) - 1), _entries(new Entry[_mask + 1]()), _window(window),
+          _windowText((window.count() % 1000 == 0) ? std::to_string(window.count() / 1000) + "s"
+                                                   : std::to_string(window.count()) + "ms"),
+          _last(std::chrono::steady_clock::now()),
+          _sink(os, capacity, policy, [this](ostream & out, bool final) { Summarize(out, final); })
+    { }
+
+    ThrowStreamDedupSink(const ThrowStreamDedupSink &) = delete;
+    ThrowStreamDedupSink & operator=(const ThrowStreamDedupSink &) = delete;
+
+
+    //! Write an exception, or count it if one like it was written recently
+    /*!
+     *  Safe to call from any number of threads. The exception is only copied
+     *  if it is written.
+     *
+     *  \param[in] ts The exception
+     *  \return False if the exception was dropped because the queue was full
+     */
+    bool Submit(const ThrowStream & ts)
+    {
+        Entry * first;
+        if(!Record(ts, first))
+            return true;
+        if(_sink.Submit(std::make_exception_ptr(ts)))
+            return true;
+        Unrecord(first);
+        return false;
+    }
+
+
+    //! Submit the exception currently being handled (from within a catch block)
+    /*!
+     *  The exception is rethrown to find out if it is a ThrowStream. Where it is
+     *  already known to be one, Submit(ts) is faster. Outside of a catch block,
+     *  nothing is submitted, and this returns false.
+     */
+    bool SubmitCurrent()
+    {
+        std::exception_ptr ptr = std::current_exception();
+        if(!ptr)
+            return false;
+
+        Entry * first = nullptr;
+        try
+        {
+            std::rethrow_exception(ptr);
+        }
+        catch(const ThrowStream & ts)
+        {
+            if(!Record(ts, first))
+                return true;
+        }
+        catch(...)
+        {
+        }
+        if(_sink.Submit(std::move(ptr)))
+            return true;
+        Unrecord(first);
+        return false;
+    }
+
+
+    //! Number of exceptions dropped because the queue was full
+    unsigned long Dropped() const
+    {
+        return _sink.Dropped();
+    }
+};
+
+#endif //BPLIB_THROWSTREAMDEDUPSINK_H
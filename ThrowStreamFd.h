@@ -0,0 +1,269 @@
+/*! \file
+ *  \brief     Write ThrowStreams directly to file descriptors (POSIX only)
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#ifndef BPLIB_THROWSTREAMFD_H
+#define BPLIB_THROWSTREAMFD_H
+
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "ThrowStream.h"
+
+
+//! Gathers segments of a backtrace and writes them with writev()
+/*!
+ *  Large segments are passed to writev() where they are, without being copied.
+ *  Small ones (which may be temporary, see ThrowStreamTemporarySegment) are
+ *  packed into a buffer on the stack. Everything is written with a single
+ *  writev() call unless there are more segments than fit in one batch.
+ */
+class ThrowStreamIovecWriter
+{
+private:
+    static const int MaxIov = 128;          //!< Segments written per writev() call
+    static const size_t SmallSegment = ThrowStreamTemporarySegment; //!< Segments up to this size are copied
+
+    int _fd;                  //!< Where to write
+    bool _ok;                 //!< False once a write has failed
+    int _niov;                //!< Number of entries in \p _iov
+    size_t _used;             //!< Bytes of \p _scratch in use
+    struct iovec _iov[MaxIov];
+    char _scratch[2048];      //!< Copies of small segments
+
+
+    //! Add an entry to the batch
+    void Add(const char * data, size_t size)
+    {
+        if(_niov == MaxIov)
+            Flush();
+        _iov[_niov].iov_base = const_cast<char *>(data);
+        _iov[_niov].iov_len = size;
+        _niov++;
+    }
+
+
+public:
+    //! Start a batch
+    /*!
+     *  \param[in] fd The file descriptor to write to
+     */
+    explicit ThrowStreamIovecWriter(int fd) : _fd(fd), _ok(true), _niov(0), _used(0) { }
+
+    ThrowStreamIovecWriter(const ThrowStreamIovecWriter &) = delete;
+    ThrowStreamIovecWriter & operator=(const ThrowStreamIovecWriter &) = delete;
+
+
+    //! Add a segment to the batch
+    void operator()(const char * data, size_t size)
+    {
+        if(size == 0)
+            return;
+
+        if(size > SmallSegment)
+        {
+            Add(data, size);
+            return;
+        }
+
+        // Flushed before copying, since Flush() reuses the scratch buffer from the start.
+        // Add() flushing afterwards would leave the new entry pointing into reused space
+        if(_used + size > sizeof(_scratch) || _niov == MaxIov)
+            Flush();
+
+        char * dst = _scratch + _used;
+        memcpy(dst, data, size);
+        _used += size;
+
+        // Merge with the previous entry if it was also copied
+        if(_niov > 0 && static_cast<char *>(_iov[_niov-1].iov_base) + _iov[_niov-1].iov_len == dst)
+            _iov[_niov-1].iov_len += size;
+        else
+            Add(dst, size);
+    }
+
+
+    //! Write everything in the batch
+    /*!
+     *  \return False if any write has failed
+     */
+    bool Flush()
+    {
+        struct iovec * iov = _iov;
+        int niov = _niov;
+
+        while(_ok && niov > 0)
+        {
+            ssize_t n = writev(_fd, iov, niov);
+            if(n < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                _ok = false;
+                break;
+            }
+
+            // Skip whatever was written
+            size_t written = size_t(n);
+            while(niov > 0 && written >= iov->iov_len)
+            {
+                written -= iov->iov_len;
+                iov++;
+                niov--;
+            }
+            if(niov > 0)
+            {
+                iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+                iov->iov_len -= written;
+            }
+        }
+
+        _niov = 0;
+        _used = 0;
+        return _ok;
+    }
+};
+
+
+//! Write the full backtrace of a ThrowStream to a file descriptor
+/*!
+ *  The output is the same as what(), but is written straight from the
+ *  ThrowStream's own storage, without building the full string first.
+ *
+ *  \param[in] fd The file descriptor to write to
+ *  \param[in] ts The ThrowStream to write
+ *  \return True if everything was written
+ */
+inline bool ThrowStreamWriteFd(int fd, const ThrowStream & ts)
+{
+    ThrowStreamIovecWriter writer(fd);
+    ts.ForEachSegment(writer);
+    writer("\n", 1);
+    return writer.Flush();
+}
+
+
+//! Write a whole buffer to a file descriptor using only write()
+/*!
+ *  Async-signal-safe. errno is left unchanged.
+ *
+ *  \param[in] fd The file descriptor to write to
+ *  \param[in] data The data to write
+ *  \param[in] size Number of bytes to write
+ *  \return True if everything was written
+ */
+inline bool ThrowStreamWriteAll(int fd, const char * data, size_t size)
+{
+    int saved = errno;
+    bool ok = true;
+
+    while(size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            ok = false;
+            break;
+        }
+        data += n;
+        size -= size_t(n);
+    }
+
+    errno = saved;
+    return ok;
+}
+
+
+//! Buffers segments on the stack and writes them with write()
+/*!
+ *  Nothing here allocates or uses locale or stdio, so it can be used from
+ *  a signal handler.
+ */
+class ThrowStreamSafeWriter
+{
+private:
+    int _fd;         //!< Where to write
+    bool _ok;        //!< False once a write has failed
+    size_t _used;    //!< Bytes of \p _buf in use
+    char _buf[512];  //!< Output not yet written
+
+public:
+    //! Start writing
+    /*!
+     *  \param[in] fd The file descriptor to write to
+     */
+    explicit ThrowStreamSafeWriter(int fd) : _fd(fd), _ok(true), _used(0) { }
+
+    ThrowStreamSafeWriter(const ThrowStreamSafeWriter &) = delete;
+    ThrowStreamSafeWriter & operator=(const ThrowStreamSafeWriter &) = delete;
+
+
+    //! Add some output
+    void operator()(const char * data, size_t size)
+    {
+        while(size > 0)
+        {
+            if(_used == sizeof(_buf))
+                Flush();
+
+            size_t n = sizeof(_buf) - _used;
+            if(n > size)
+                n = size;
+            memcpy(_buf + _used, data, n);
+            _used += n;
+            data += n;
+            size -= n;
+        }
+    }
+
+
+    //! Add a null-terminated string
+    void operator()(const char * str)
+    {
+        (*this)(str, strlen(str));
+    }
+
+
+    //! Write everything buffered so far
+    /*!
+     *  \return False if any write has failed
+     */
+    bool Flush()
+    {
+        if(_used > 0 && !ThrowStreamWriteAll(_fd, _buf, _used))
+            _ok = false;
+        _used = 0;
+        return _ok;
+    }
+};
+
+
+//! Write the full backtrace of a ThrowStream to a file descriptor, from anywhere
+/*!
+ *  Only a buffer on the stack and write() are used. Nothing is allocated and
+ *  no locale or stdio functions are called, so this is safe to use in a signal
+ *  handler or std::terminate handler, even when the heap may be corrupted.
+ *  The ThrowStream's own storage is only read.
+ *
+ *  The exception is that copied or aggregated exceptions which are not ThrowStreams
+ *  are written using their what(), which is up to the exception's type. Error
+ *  codes are written as their category and number only, without the message.
+ *
+ *  \param[in] fd The file descriptor to write to
+ *  \param[in] ts The ThrowStream to write
+ *  \return True if everything was written
+ */
+inline bool ThrowStreamRenderToFd(int fd, const ThrowStream & ts)
+{
+    ThrowStreamSafeWriter writer(fd);
+    ts.ForEachSegment(writer, true);
+    writer("\n", 1);
+    return writer.Flush();
+}
+
+#endif //BPLIB_THROWSTREAMFD_H
@@ -0,0 +1,342 @@
+/*! \file
+ *  \brief     Gather ThrowStreams from worker processes into one (POSIX only)
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  Each worker (rank) sends its exception with ThrowStreamSend over a pipe or a
+ *  Unix socket. The coordinator receives them with a ThrowStreamGather, which
+ *  merges them into an AggregateThrowStream. Exceptions with the same callsite
+ *  chain are printed once, labelled with all of the ranks they came from:
+ *
+ *  \code{.unparsed}
+ *    ( main.cpp:80 , in main() )    ->  3 of 16 ranks failed
+ *        rank 3, 7, 12:
+ *        ( input.cpp:41 , in Parse() )    ->  Bad value in row 17
+ *        ( worker.cpp:22 , in Run() )    ->  Reading input.dat
+ *  \endcode
+ */
+
+#ifndef BPLIB_THROWSTREAMGATHER_H
+#define BPLIB_THROWSTREAMGATHER_H
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ThrowStream.h"
+#include "AggregateThrowStream.h"
+#include "ThrowStreamFd.h"
+
+
+//! Size of the header in front of each message: the rank and the size of the data (32-bit, little-endian)
+static const size_t ThrowStreamGatherHeader = 8;
+
+
+//! Send a ThrowStream to a ThrowStreamGather in another process
+/*!
+ *  The exception is written with ThrowStream::Serialize, after a small header.
+ *  Each worker should have its own pipe or connection, since a large message
+ *  may not be written to a pipe in one piece. Several exceptions may be sent
+ *  over the same one.
+ *
+ *  \param[in] fd The pipe or socket to write to
+ *  \param[in] ts The exception to send
+ *  \param[in] rank Which worker this is
+ *  \return True if everything was written
+ */
+inline bool ThrowStreamSend(int fd, const ThrowStream & ts, unsigned long rank)
+{
+    // Most exceptions fit on the stack, so are serialized only once
+    char stack[4096];
+    std::vector<char> heap;
+    char * buf = stack;
+
+    size_t size = ts.Serialize(buf + ThrowStreamGatherHeader, sizeof(stack) - ThrowStreamGatherHeader);
+    if(size > sizeof(stack) - ThrowStreamGatherHeader)
+    {
+        heap.resize(ThrowStreamGatherHeader + size);
+        buf = heap.data();
+        ts.Serialize(buf + ThrowStreamGatherHeader, size);
+    }
+
+    for(int i = 0; i < 4; i++)
+    {
+        buf[i] = char((rank >> (8 * i)) & 0xff);
+        buf[4 + i] = char((size >> (8 * i)) & 0xff);
+    }
+
+    return ThrowStreamWriteAll(fd, buf, ThrowStreamGatherHeader + size);
+}
+
+
+//! Receives ThrowStreams from worker processes, and merges them into an AggregateThrowStream
+/*!
+ *  \code{.cpp}
+ *    ThrowStreamGather gather;
+ *    gather.Receive(fds);              // read end of each worker's pipe
+ *
+ *    if(!gather.Empty())
+ *        THROWSTREAMAGGREGATE(gather) << gather.Ranks() << " of " << nranks << " ranks failed";
+ *  \endcode
+ *
+ *  Only the coordinator uses this; it is not thread-safe.
+ */
+class ThrowStreamGather
+{
+private:
+    static const size_t MaxMessage = 64 * 1024 * 1024; //!< Larger messages are treated as corrupt
+
+    //! An exception received from a worker
+    struct Received
+    {
+        unsigned long rank;
+        std::shared_ptr<const ThrowStream> ts;
+    };
+
+    std::vector<Received> _received; //!< Everything received so far, in order
+
+
+    //! Take any complete messages from the start of a buffer
+    void Parse(std::vector<char> & buf)
+    {
+        size_t pos = 0;
+        while(buf.size() - pos >= ThrowStreamGatherHeader)
+        {
+            const unsigned char * h = reinterpret_cast<const unsigned char *>(buf.data() + pos);
+            unsigned long rank = 0;
+            size_t size = 0;
+            for(int i = 3; i >= 0; i--)
+            {
+                rank = (rank << 8) | h[i];
+                size = (size << 8) | h[4 + i];
+            }
+
+            if(size > MaxMessage)
+                THROWSTREAM << "Message of " << size << " bytes from rank " << rank << " is too large";
+            if(buf.size() - pos - ThrowStreamGatherHeader < size)
+                break;
+
+            Add(rank, ThrowStream::Deserialize(buf.data() + pos + ThrowStreamGatherHeader, size));
+            pos += ThrowStreamGatherHeader + size;
+        }
+        buf.erase(buf.begin(), buf.begin() + pos);
+    }
+
+
+public:
+    //! Add an exception (for example, one from this process)
+    /*!
+     *  \param[in] rank Where it came from
+     *  \param[in] ts The exception
+     */
+    void Add(unsigned long rank, const ThrowStream & ts)
+    {
+        Received r = { rank, std::make_shared<const ThrowStream>(ts) };
+        _received.push_back(std::move(r));
+    }
+
+
+    //! Read exceptions sent with ThrowStreamSend until each file descriptor is closed by the worker
+    /*!
+     *  All of the file descriptors are read at once with poll(), so no worker
+     *  is left waiting. They are not closed here.
+     *
+     *  \param[in] fds The read ends of the workers' pipes or connections
+     */
+    void Receive(const std::vector<int> & fds)
+    {
+        std::vector<struct pollfd> pfds(fds.size());
+        std::vector<std::vector<char>> bufs(fds.size());
+        size_t open = fds.size();
+
+        for(size_t i = 0; i < fds.size(); i++)
+        {
+            pfds[i].fd = fds[i];
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+
+        while(open > 0)
+        {
+            if(poll(pfds.data(), pfds.size(), -1) < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                THROWSTREAMERRNO << "Waiting for workers";
+            }
+
+            for(size_t i = 0; i < pfds.size(); i++)
+            {
+                if(pfds[i].fd < 0 || pfds[i].revents == 0)
+                    continue;
+
+                char chunk[16384];
+                ssize_t n = read(pfds[i].fd, chunk, sizeof(chunk));
+                if(n < 0)
+                {
+                    if(errno == EINTR || errno == EAGAIN)
+                        continue;
+                    THROWSTREAMERRNO << "Reading from a worker";
+                }
+
+                if(n == 0)
+                {
+                    if(!bufs[i].empty())
+                        THROWSTREAM << "A worker closed its connection in the middle of a message";
+                    pfds[i].fd = -1; // ignored by poll() from now on
+                    open--;
+                    continue;
+                }
+
+                bufs[i].insert(bufs[i].end(), chunk, chunk + n);
+                Parse(bufs[i]);
+            }
+        }
+    }
+
+
+    //! Accept connections on a listening Unix socket, then read from them (see Receive)
+    /*!
+     *  \param[in] listenFd The listening socket
+     *  \param[in] count Number of workers that will connect
+     */
+    void ReceiveConnections(int listenFd, size_t count)
+    {
+        std::vector<int> fds;
+        while(fds.size() < count)
+        {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if(fd >= 0)
+                fds.push_back(fd);
+            else if(errno != EINTR)
+            {
+                for(size_t i = 0; i < fds.size(); i++)
+                    close(fds[i]);
+                THROWSTREAMERRNO << "Accepting connections from workers";
+            }
+        }
+
+        try
+        {
+            Receive(fds);
+        }
+        catch(...)
+        {
+            for(size_t i = 0; i < fds.size(); i++)
+                close(fds[i]);
+            throw;
+        }
+
+        for(size_t i = 0; i < fds.size(); i++)
+            close(fds[i]);
+    }
+
+
+    //! Number of exceptions received
+    size_t Size() const
+    {
+        return _received.size();
+    }
+
+
+    //! Has anything been received?
+    bool Empty() const
+    {
+        return _received.empty();
+    }
+
+
+    //! Number of different ranks that sent an exception
+    size_t Ranks() const
+    {
+        std::vector<unsigned long> ranks;
+        for(size_t i = 0; i < _received.size(); i++)
+            ranks.push_back(_received[i].rank);
+        std::sort(ranks.begin(), ranks.end());
+        return size_t(std::unique(ranks.begin(), ranks.end()) - ranks.begin());
+    }
+
+
+    //! Create an AggregateThrowStream from everything received
+    /*!
+     *  Exceptions with the same callsite chain (see ThrowStreamSameChain) are
+     *  merged, keeping the one from the lowest rank. Each is labelled with the
+     *  ranks it came from, with runs written as ranges ("rank 0-63, 65").
+     *
+     *  \param[in] loc Where the exception occurred
+     */
+    AggregateThrowStream Build(const ThrowStreamLocation & loc) const
+    {
+        std::vector<Received> received(_received);
+        std::stable_sort(received.begin(), received.end(),
+                         [](const Received & a, const Received & b) { return a.rank < b.rank; });
+
+        std::vector<ThrowStreamChild> groups;   // first exception of each chain
+        std::vector<std::vector<unsigned long>> ranks;
+
+        for(size_t i = 0; i < received.size(); i++)
+        {
+            ThrowStreamChild child = { nullptr, received[i].ts.get(), received[i].ts.get(), nullptr };
+
+            size_t g = 0;
+            while(g < groups.size() && !ThrowStreamSameChain(child, groups[g]))
+                g++;
+
+            if(g == groups.size())
+            {
+                child.ptr = std::make_exception_ptr(*received[i].ts);
+                groups.push_back(child);
+                ranks.push_back(std::vector<unsigned long>());
+            }
+            if(ranks[g].empty() || ranks[g].back() != received[i].rank)
+                ranks[g].push_back(received[i].rank);
+        }
+
+        std::shared_ptr<std::vector<ThrowStreamChild>> children(new std::vector<ThrowStreamChild>);
+        for(size_t g = 0; g < groups.size(); g++)
+        {
+            ThrowStreamChild child = { groups[g].ptr, nullptr, nullptr, nullptr };
+
+            // Point at the copy held by the exception_ptr, which lives as long as the aggregate
+            try
+            {
+                std::rethrow_exception(child.ptr);
+            }
+            catch(const ThrowStream & ts)
+            {
+                child.ex = &ts;
+                child.ts = &ts;
+            }
+
+            stringstream label;
+            label << "rank ";
+            const std::vector<unsigned long> & r = ranks[g];
+            for(size_t i = 0; i < r.size(); )
+            {
+                size_t j = i;
+                while(j + 1 < r.size() && r[j + 1] == r[j] + 1)
+                    j++;
+
+                if(i > 0)
+                    label << ", ";
+                label << r[i];
+                if(j >= i + 2)
+                    label << "-" << r[j];
+                else if(j == i + 1)
+                    label << ", " << r[j];
+                i = j + 1;
+            }
+
+            child.label = std::make_shared<const string>(label.str());
+            children->push_back(std::move(child));
+        }
+
+        return AggregateThrowStream(children, loc);
+    }
+};
+
+#endif //BPLIB_THROWSTREAMGATHER_H
@@ -0,0 +1,331 @@
+/*! \file
+ *  \brief     The parts of ThrowStream that aren't needed to throw (rendering, mostly)
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  This is compiled once, in the throwstream library (src/ThrowStream.cpp) or in the
+ *  file that defines THROWSTREAM_IMPLEMENTATION, rather than in every file that throws.
+ *  Code using ThrowStreamBasic with policies other than the defaults should include it.
+ */
+
+#ifndef BPLIB_THROWSTREAMIMPL_H
+#define BPLIB_THROWSTREAMIMPL_H
+
+#include "ThrowStream.h"
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+void ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::VisitMessage(const Frame & f, SegmentFn fn, void * ctx, bool safe)
+{
+    size_t pos = 0;
+    for(size_t i = 0; i < f.deferred.size(); i++)
+    {
+        const DeferredInsert & d = f.deferred[i];
+        fn(ctx, f.message.data() + pos, d.offset - pos);
+        d.piece->Visit(fn, ctx, safe);
+        pos = d.offset;
+    }
+    fn(ctx, f.message.data() + pos, f.message.size() - pos);
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+void ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::VisitErrorCode(const Frame & f, SegmentFn fn, void * ctx, bool safe)
+{
+    char digits[24];
+    const char * name = f.errorCategory->name();
+    unsigned long long value = (f.errorValue < 0) ? 0ULL - (unsigned long long)f.errorValue
+                                                  : (unsigned long long)f.errorValue;
+
+    fn(ctx, " (", 2);
+    fn(ctx, name, strlen(name));
+    fn(ctx, " error ", 7);
+    if(f.errorValue < 0)
+        fn(ctx, "-", 1);
+    fn(ctx, digits, ThrowStreamFormatUnsigned(digits, value));
+
+    if(!safe)
+    {
+        const string msg = f.errorCategory->message(f.errorValue);
+        fn(ctx, ": ", 2);
+        ThrowStreamVisitTemporary(fn, ctx, msg.data(), msg.size());
+    }
+
+    fn(ctx, ")", 1);
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+void ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::AppendSegment(void * str, const char * data, size_t size)
+{
+    static_cast<string *>(str)->append(data, size);
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+string ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::Render() const
+{
+    string out;
+    VisitSegments(&AppendSegment, &out);
+    return out;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+void ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::VisitSegments(SegmentFn fn, void * ctx, bool safe) const
+{
+    for(size_t i = 0; i < _frames.size(); i++)
+    {
+        const Frame & f = _frames[i];
+        fn(ctx, "\n", 1);
+
+        if(f.external)
+        {
+            const char * what = f.ExternalWhat();
+            fn(ctx, what, strlen(what));
+            continue;
+        }
+
+        RenderPolicy::VisitLocation(f, fn, ctx);
+
+        VisitMessage(f, fn, ctx, safe);
+
+        if(f.errorCategory != nullptr)
+            VisitErrorCode(f, fn, ctx, safe);
+
+        if(f.children)
+            ThrowStreamVisitChildren(*f.children, fn, ctx, safe);
+    }
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+char const* ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::what() const throw()
+{
+    const string * desc = _desc.load(std::memory_order_acquire);
+    if(desc != nullptr)
+        return desc->c_str();
+
+#ifdef THROWSTREAM_EXCEPTIONS
+    try
+#endif
+    {
+        string * rendered = new string(Render());
+        if(_desc.compare_exchange_strong(desc, rendered, std::memory_order_acq_rel))
+            return rendered->c_str();
+
+        // Another thread rendered it first
+        delete rendered;
+        return desc->c_str();
+    }
+#ifdef THROWSTREAM_EXCEPTIONS
+    catch(...)
+    {
+        return "ThrowStream: unable to render the description";
+    }
+#endif
+}
+
+
+// The stream operator for common types (see the declarations)
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(const char * rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(const string & rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(char rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(bool rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(int rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(unsigned int rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(long rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(unsigned long rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(long long rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(unsigned long long rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy> &
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::operator<<(double rhs)
+{
+    FormatPolicy::Append(*this, _frames.back().message, rhs);
+    Invalidate();
+    return *this;
+}
+
+
+// These are defined once, in the library or the file defining THROWSTREAM_IMPLEMENTATION
+#ifdef THROWSTREAM_IMPLEMENTATION_FILE
+
+//! Compare file or function names (usually the same pointer)
+THROWSTREAM_COLD bool ThrowStreamSameName(const char * a, const char * b)
+{
+    return a == b || strcmp(a, b) == 0;
+}
+
+
+THROWSTREAM_COLD bool ThrowStreamSameChain(const ThrowStreamChild & a, const ThrowStreamChild & b)
+{
+    if(a.ts != nullptr && b.ts != nullptr)
+    {
+        // Different fingerprints can only come from different chains
+        if(a.ts->Fingerprint() != b.ts->Fingerprint() || a.ts->Frames().size() != b.ts->Frames().size())
+            return false;
+
+        for(size_t i = 0; i < a.ts->Frames().size(); i++)
+        {
+            const ThrowStream::Frame & fa = a.ts->Frames()[i];
+            const ThrowStream::Frame & fb = b.ts->Frames()[i];
+            if(fa.line != fb.line || fa.column != fb.column)
+                return false;
+            if(!ThrowStreamSameName(fa.file, fb.file) || !ThrowStreamSameName(fa.function, fb.function))
+                return false;
+            if(fa.external != fb.external)
+                return false;
+            if(fa.external && strcmp(fa.ExternalWhat(), fb.ExternalWhat()) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    if(a.ts != nullptr || b.ts != nullptr)
+        return false;
+    if(a.ex == nullptr || b.ex == nullptr)
+        return a.ex == b.ex;
+    return strcmp(a.ex->what(), b.ex->what()) == 0;
+}
+
+
+THROWSTREAM_COLD void ThrowStreamVisitChildren(const std::vector<ThrowStreamChild> & children,
+                                               ThrowStreamSegmentFn fn, void * ctx, bool safe)
+{
+    ThrowStreamIndent ind = { fn, ctx };
+
+    for(size_t i = 0; i < children.size(); i++)
+    {
+        const ThrowStreamChild & child = children[i];
+
+        if(child.label)
+        {
+            fn(ctx, "\n    ", 5);
+            fn(ctx, child.label->data(), child.label->size());
+            fn(ctx, ":", 1);
+        }
+        else
+        {
+            // Was this chain already printed?
+            bool seen = false;
+            for(size_t j = 0; j < i && !seen; j++)
+                seen = !children[j].label && ThrowStreamSameChain(child, children[j]);
+            if(seen)
+                continue;
+
+            unsigned long count = 1;
+            for(size_t j = i + 1; j < children.size(); j++)
+                count += (!children[j].label && ThrowStreamSameChain(child, children[j])) ? 1 : 0;
+
+            char digits[24];
+            fn(ctx, "\n    ", 5);
+            fn(ctx, digits, ThrowStreamFormatUnsigned(digits, count));
+            fn(ctx, "x:", 2);
+        }
+
+        if(child.ts != nullptr)
+            child.ts->VisitSegments(&ThrowStreamIndent::Call, &ind, safe);
+        else
+        {
+            const char * text = (child.ex != nullptr) ? child.ex->what() : "Unknown exception";
+            if(text[0] != '\n')
+                ThrowStreamIndent::Call(&ind, "\n", 1);
+            ThrowStreamIndent::Call(&ind, text, strlen(text));
+        }
+    }
+}
+
+#endif
+
+#endif //BPLIB_THROWSTREAMIMPL_H
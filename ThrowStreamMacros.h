@@ -0,0 +1,287 @@
+/*! \file
+ *  \brief     The ThrowStream macros
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  This is included by ThrowStream.h. Macros can't be exported from a module,
+ *  so code that uses <tt>import throwstream;</tt> (see ThrowStream.cppm) includes
+ *  this directly instead. It doesn't include anything else, other than <csetjmp>
+ *  when exceptions are disabled.
+ */
+
+#ifndef BPLIB_THROWSTREAMMACROS_H
+#define BPLIB_THROWSTREAMMACROS_H
+
+// Are exceptions enabled? If not, the throwing macros call a failure handler instead
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define THROWSTREAM_EXCEPTIONS
+#else
+#include <csetjmp>
+#endif
+
+
+//! The current file, relative to THROWSTREAM_SOURCE_ROOT if that is defined
+/*!
+ *  The prefix is found at compile time, so this is still a pointer to a literal.
+ *  Compilers that support -fmacro-prefix-map can trim __FILE__ itself, which
+ *  also keeps the full path out of the binary (the CMake build does this).
+ */
+#ifdef THROWSTREAM_SOURCE_ROOT
+#define THROWSTREAMFILE (__FILE__ + ThrowStreamConstant<ThrowStreamPrefixLength(__FILE__, THROWSTREAM_SOURCE_ROOT)>::value)
+#else
+#define THROWSTREAMFILE __FILE__
+#endif
+
+
+//! The current location, for the macros
+/*!
+ *  Only pointers to the __FILE__ and __FUNCTION__ literals are stored, so no
+ *  strings are built when throwing.
+ */
+#define THROWSTREAMLOCATION ThrowStreamLocation(__LINE__, THROWSTREAMFILE, __FUNCTION__)
+
+
+//! Create a THROWSTREAM object representing an exception at this location, and throw it
+/*!
+ *  This is used primarily to throw the first exception. To add a description:
+ *
+ *  \code{.cpp}
+ *    THROWSTREAM << "Some description: " << somevar;
+ *  \endcode
+ *
+ *  If the work on this thread has been cancelled (see ThrowStreamCancel.h), a
+ *  ThrowStreamCancelled is thrown instead and nothing is formatted.
+ *
+ *  When built without exceptions, the failure handler is called at the end
+ *  of the statement instead (see ThrowStreamNoExcept.h).
+ */
+#ifdef THROWSTREAM_EXCEPTIONS
+#define THROWSTREAM throw (ThrowStreamCheckCancelled(), ThrowStream(THROWSTREAMLOCATION))
+#else
+#define THROWSTREAM ThrowStreamRaiser(THROWSTREAMLOCATION)
+#endif
+
+
+//! Copy information from another exception, and then throw the exception
+/*!
+ *  The exception to copied can be an std::exception or any derivative of std::exception
+ *
+ *  \code{.cpp}
+ *    THROWSTREAMAPPEND(somex) << "Called from here: somevar = " << somevar;
+ *  \endcode
+ *
+ *  As with THROWSTREAM, a ThrowStreamCancelled is thrown instead if the work on
+ *  this thread has been cancelled.
+ */
+#ifdef THROWSTREAM_EXCEPTIONS
+#define THROWSTREAMAPPEND(ex) throw (ThrowStreamCheckCancelled(), ThrowStream( (ex), THROWSTREAMLOCATION))
+#else
+#define THROWSTREAMAPPEND(ex) ThrowStreamRaiser( (ex), THROWSTREAMLOCATION)
+#endif
+
+
+//! Create a THROWSTREAM object holding the current value of errno, and throw it
+/*!
+ *  Only the number is stored; the text from strerror() is looked up when the
+ *  exception is rendered. Otherwise the same as THROWSTREAM.
+ *
+ *  \code{.cpp}
+ *    if(fd < 0)
+ *        THROWSTREAMERRNO << "Can't open " << path;
+ *  \endcode
+ */
+#ifdef THROWSTREAM_EXCEPTIONS
+#define THROWSTREAMERRNO throw (ThrowStreamCheckCancelled(), ThrowStream(ThrowStreamErrnoCode(), THROWSTREAMLOCATION))
+#else
+#define THROWSTREAMERRNO ThrowStreamRaiser(ThrowStreamErrnoCode(), THROWSTREAMLOCATION)
+#endif
+
+
+//! Create a THROWSTREAM object holding an std::error_code, and throw it
+/*!
+ *  As with THROWSTREAMERRNO, the message is looked up when the exception is rendered.
+ *
+ *  \code{.cpp}
+ *    THROWSTREAMEC(ec) << "Can't connect to " << host;
+ *  \endcode
+ *
+ *  \param ec The error code
+ */
+#ifdef THROWSTREAM_EXCEPTIONS
+#define THROWSTREAMEC(ec) throw (ThrowStreamCheckCancelled(), ThrowStream( (ec), THROWSTREAMLOCATION))
+#else
+#define THROWSTREAMEC(ec) ThrowStreamRaiser( (ec), THROWSTREAMLOCATION)
+#endif
+
+
+//! Define an exception class for a category of errors
+/*!
+ *  The class derives from \p parent, which is either another category or ThrowStream,
+ *  so catch sites can handle a whole family of errors by type. The category
+ *  also goes along when the exception is appended to a plain ThrowStream,
+ *  and can be checked with ThrowStream::IsCategory().
+ *
+ *  \code{.cpp}
+ *    THROWSTREAMCATEGORY(IoError, ThrowStream);
+ *    THROWSTREAMCATEGORY(FileNotFound, IoError);
+ *    ...
+ *    THROWSTREAMAS(FileNotFound) << "Can't open " << path;
+ *    ...
+ *    catch(const IoError & ex)
+ *  \endcode
+ *
+ *  \param name The name of the new class
+ *  \param parent The class it derives from
+ */
+#define THROWSTREAMCATEGORY(name, parent) \
+    class name : public ThrowStreamCategoryBase<name, parent> \
+    { \
+    public: \
+        using ThrowStreamCategoryBase<name, parent>::ThrowStreamCategoryBase; \
+        static const ThrowStreamCategoryInfo * Category() \
+        { \
+            static const ThrowStreamCategoryInfo info = { #name, parent::Category() }; \
+            return &info; \
+        } \
+    }
+
+
+//! Create an exception of a category defined with THROWSTREAMCATEGORY, and throw it
+/*!
+ *  Otherwise the same as THROWSTREAM. The category is part of the type, so
+ *  nothing extra is done at run time.
+ *
+ *  \code{.cpp}
+ *    THROWSTREAMAS(FileNotFound) << "Can't open " << path;
+ *  \endcode
+ *
+ *  \param cat The category class
+ */
+#ifdef THROWSTREAM_EXCEPTIONS
+#define THROWSTREAMAS(cat) throw (ThrowStreamCheckCancelled(), cat(THROWSTREAMLOCATION))
+#else
+#define THROWSTREAMAS(cat) ThrowStreamRaiser(cat(THROWSTREAMLOCATION))
+#endif
+
+
+//! Creates a ThrowStream object with a specified name with the current location added
+/*!
+ *  This is to allow appending to it later (see THROWSTREAMOBJAPPEND). This does not
+ *  actually throw the exception
+ *
+ *  \code{.cpp}
+ *    THROWSTREAMOBJ(myex) << "Called from here: somevar = " << somevar;
+ *  \endcode
+ *
+ *  \param ex The name of the object to create
+ */
+#define THROWSTREAMOBJ(ex) ThrowStream (ex)(THROWSTREAMLOCATION); (ex)
+
+
+//! Add information to an already-named ThrowStream object
+/*!
+ *  Adds location information. This does not throw the exception.
+ *
+ *  \code{.cpp}
+ *    THROWSTREAMOBJAPPEND(myex) << "Called from here: somevar = " << somevar;
+ *  \endcode
+ *
+ *  \param ex The name of the object to append to
+ */
+#define THROWSTREAMOBJAPPEND(ex) (ex).Append(THROWSTREAMLOCATION)
+
+
+//! Copy a ThrowStream object into an already-created object, and add the current location.
+/*!
+ *  Adds location information as well. This does not throw the exception.
+ *  The exception to copy can be an std::exception or any derivative of std::exception
+ *
+ *  \param ex The object to append to
+ *  \param ey The exception to be appended
+ */
+#define THROWSTREAMOBJAPPENDCOPY(ex,ey) ex.Append((ey), THROWSTREAMLOCATION)
+
+
+//! Creates a ThrowStream object based on another exception.
+/*!
+ *  Adds location information as well. This does not throw the exception.
+ *  The exception to copy can be an std::exception or any derivative of std::exception
+ *
+ *  \param ex The name of the object to create
+ *  \param ey The exception object to copy
+ */
+#define THROWSTREAMOBJCOPY(ex,ey) ThrowStream (ex)((ey), THROWSTREAMLOCATION); (ex)
+
+
+//! Add the names and values of some variables
+/*!
+ *  \code{.cpp}
+ *    THROWSTREAMAPPEND(ex) << "Called from MultiplyInverse: " << THROWSTREAMVARS(a, b);
+ *  \endcode
+ *
+ *  gives "Called from MultiplyInverse: a=1 b=0". The names are split once for each
+ *  place the macro is used. Numbers, enums, and pointers are copied and only formatted
+ *  if the backtrace is rendered; other values are formatted straight away.
+ *
+ *  This can also be written to any ostream. Needs ThrowStreamVars.h.
+ */
+#define THROWSTREAMVARS(...) \
+    ThrowStreamMakeVars([]() -> const ThrowStreamVarLayout & \
+                        { \
+                            static const ThrowStreamVarLayout layout(#__VA_ARGS__); \
+                            return layout; \
+                        }(), __VA_ARGS__)
+
+
+//! Throw an AggregateThrowStream holding everything added to a builder
+/*!
+ *  \code{.cpp}
+ *    if(!errors.Empty())
+ *        THROWSTREAMAGGREGATE(errors) << errors.Size() << " tasks failed";
+ *  \endcode
+ *
+ *  Needs AggregateThrowStream.h.
+ *
+ *  \param b The AggregateThrowStreamBuilder to use
+ */
+#define THROWSTREAMAGGREGATE(b) throw (b).Build(THROWSTREAMLOCATION)
+
+
+//! Add an entry at this location to a ThrowStreamCollector
+/*!
+ *  Can be used from many threads at once. This does not throw anything.
+ *  Needs ThrowStreamCollector.h.
+ *
+ *  \code{.cpp}
+ *    THROWSTREAMCOLLECT(errors) << "Bad value in row " << i << ": " << value;
+ *  \endcode
+ *
+ *  \param c The ThrowStreamCollector to add to
+ */
+#define THROWSTREAMCOLLECT(c) (c).Add(__LINE__, THROWSTREAMFILE, __FUNCTION__)
+
+
+//! Wrap a callable so that exceptions it throws record where it was submitted from
+/*!
+ *  The wrapped object can be handed to any thread pool, std::thread, std::async, etc.
+ *  Needs ThrowStreamTask.h.
+ *
+ *  \code{.cpp}
+ *    pool.submit(THROWSTREAMTASK([=]{ Process(chunk); }));
+ *  \endcode
+ *
+ *  \param f The callable to wrap
+ */
+#define THROWSTREAMTASK(f) ThrowStreamMakeTask((f), __LINE__, THROWSTREAMFILE, __FUNCTION__)
+
+
+//! Set a ThrowStreamCheckpoint. True when first called, false after a jump back to it
+/*!
+ *  Must be used directly as the condition of an if statement (a requirement of setjmp).
+ *  Only available when exceptions are disabled (see ThrowStreamNoExcept.h).
+ *
+ *  \param cp The checkpoint to set
+ */
+#define THROWSTREAMCHECKPOINT(cp) (setjmp((cp).env) == 0)
+
+#endif //BPLIB_THROWSTREAMMACROS_H
@@ -0,0 +1,264 @@
+/*! \file
+ *  \brief     Support for using the ThrowStream macros in code built without exceptions
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  This is included by ThrowStream.h when exceptions are disabled (for example,
+ *  with -fno-exceptions). It should not be included directly.
+ */
+
+#ifndef BPLIB_THROWSTREAMNOEXCEPT_H
+#define BPLIB_THROWSTREAMNOEXCEPT_H
+
+#include <atomic>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <type_traits>
+#include "ThrowStream.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include "ThrowStreamFd.h"
+#endif
+
+
+//! Called in place of throwing a ThrowStream when exceptions are disabled
+/*!
+ *  The handler must not return. If it does, the program is aborted.
+ */
+typedef void (*ThrowStreamFailureHandler)(const ThrowStream & ts);
+
+
+//! The default failure handler. Writes the backtrace to stderr and aborts
+/*!
+ *  Uses the same allocation-free path as ThrowStreamRenderToFd where it is
+ *  available (POSIX), and stdio otherwise.
+ */
+[[noreturn]] inline void ThrowStreamAbortHandler(const ThrowStream & ts)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    ThrowStreamSafeWriter w(2);
+    w("\nFatal error:");
+    ts.ForEachSegment(w, true);
+    w("\n");
+    w.Flush();
+#else
+    std::fputs("\nFatal error:", stderr);
+    ts.ForEachSegment([](const char * data, size_t size) { std::fwrite(data, 1, size, stderr); }, true);
+    std::fputs("\n", stderr);
+    std::fflush(stderr);
+#endif
+    std::abort();
+}
+
+
+//! Get the failure handler in use
+inline std::atomic<ThrowStreamFailureHandler> & ThrowStreamFailureHandlerRef()
+{
+    static std::atomic<ThrowStreamFailureHandler> handler(&ThrowStreamAbortHandler);
+    return handler;
+}
+
+
+//! Set the function called in place of throwing a ThrowStream
+/*!
+ *  \param[in] handler The new handler (null to restore the default)
+ *  \return The previous handler
+ */
+inline ThrowStreamFailureHandler ThrowStreamSetFailureHandler(ThrowStreamFailureHandler handler)
+{
+    if(handler == nullptr)
+        handler = &ThrowStreamAbortHandler;
+    return ThrowStreamFailureHandlerRef().exchange(handler);
+}
+
+
+//! The exception being passed to the failure handler on this thread, if it was copied for it
+/*!
+ *  It is kept here rather than on the stack, where its destructor would be skipped
+ *  if the handler calls longjmp(). It is replaced by the next one raised on this thread.
+ */
+inline std::unique_ptr<ThrowStream> & ThrowStreamRaised()
+{
+    static thread_local std::unique_ptr<ThrowStream> raised;
+    return raised;
+}
+
+
+//! Pass a ThrowStream (or a class derived from it) to the failure handler
+template<typename T>
+[[noreturn]] void ThrowStreamRaise(const T & ts, std::true_type)
+{
+    ThrowStreamFailureHandlerRef().load()(ts);
+    std::abort();
+}
+
+
+//! Pass a ThrowStreamBasic with other policies to the failure handler, as a ThrowStream
+template<typename T>
+[[noreturn]] void ThrowStreamRaise(const T & ts, std::false_type)
+{
+    std::unique_ptr<ThrowStream> & raised = ThrowStreamRaised();
+    raised.reset(new ThrowStream(ts));
+    ThrowStreamFailureHandlerRef().load()(*raised);
+    std::abort();
+}
+
+
+template<typename T>
+[[noreturn]] void ThrowStreamRaise(const T & ts)
+{
+    ThrowStreamRaise(ts, std::is_base_of<ThrowStream, T>());
+}
+
+
+//! Builds a ThrowStream with the stream operator, then calls the failure handler
+/*!
+ *  Used by THROWSTREAM and THROWSTREAMAPPEND when exceptions are disabled. The handler
+ *  is called when this object is destroyed, at the end of the statement.
+ */
+class ThrowStreamRaiser
+{
+private:
+    ThrowStream _ts; //!< The exception being built
+
+public:
+    //! Construct using a location
+    explicit ThrowStreamRaiser(const ThrowStreamLocation & loc)
+        : _ts(loc)
+    { }
+
+    //! Construct by copying an exception and adding a new location
+    ThrowStreamRaiser(const exception & ex, const ThrowStreamLocation & loc)
+        : _ts(ex, loc)
+    { }
+
+    //! Construct using an error code and a location
+    ThrowStreamRaiser(const std::error_code & ec, const ThrowStreamLocation & loc)
+        : _ts(ec, loc)
+    { }
+
+    //! Start from an existing ThrowStream (used by THROWSTREAMAS)
+    explicit ThrowStreamRaiser(const ThrowStream & ts)
+        : _ts(ts)
+    { }
+
+    ThrowStreamRaiser(const ThrowStreamRaiser &) = delete;
+    ThrowStreamRaiser & operator=(const ThrowStreamRaiser &) = delete;
+
+    //! Calls the failure handler. Never returns
+    /*!
+     *  The exception is moved out first (see ThrowStreamRaised), so nothing
+     *  is left here to leak if the handler calls longjmp().
+     */
+    [[noreturn]] ~ThrowStreamRaiser()
+    {
+        std::unique_ptr<ThrowStream> & raised = ThrowStreamRaised();
+        raised.reset(new ThrowStream(std::move(_ts)));
+        ThrowStreamFailureHandlerRef().load()(*raised);
+        std::abort();
+    }
+
+    //! Add information to the exception (see ThrowStream::operator<<)
+    template<typename T>
+    ThrowStreamRaiser & operator<<(const T & rhs)
+    {
+        _ts << rhs;
+        return *this;
+    }
+};
+
+
+//! A point to return to with longjmp() when a ThrowStream is raised
+/*!
+ *  While a checkpoint exists, ThrowStreamLongjmpHandler (if installed) jumps back
+ *  to the innermost one, which then holds the ThrowStream.
+ *
+ *  \code{.cpp}
+ *    ThrowStreamSetFailureHandler(&ThrowStreamLongjmpHandler);
+ *
+ *    ThrowStreamCheckpoint cp;
+ *    if(THROWSTREAMCHECKPOINT(cp))
+ *        DoWork();
+ *    else
+ *        ReportError(*cp.Error());
+ *  \endcode
+ *
+ *  Like any use of longjmp(), destructors of objects between the failure
+ *  and the checkpoint are not run.
+ */
+class ThrowStreamCheckpoint
+{
+private:
+    ThrowStreamCheckpoint * _previous;    //!< The enclosing checkpoint
+    std::unique_ptr<ThrowStream> _error;  //!< The raised exception (null if none)
+
+public:
+    std::jmp_buf env; //!< Set by THROWSTREAMCHECKPOINT
+
+    ThrowStreamCheckpoint() : _previous(Current())
+    {
+        Current() = this;
+    }
+
+    ~ThrowStreamCheckpoint()
+    {
+        Current() = _previous;
+    }
+
+    ThrowStreamCheckpoint(const ThrowStreamCheckpoint &) = delete;
+    ThrowStreamCheckpoint & operator=(const ThrowStreamCheckpoint &) = delete;
+
+
+    //! The innermost checkpoint on this thread (null if none)
+    static ThrowStreamCheckpoint *& Current()
+    {
+        static thread_local ThrowStreamCheckpoint * current = nullptr;
+        return current;
+    }
+
+
+    //! Get the exception that was raised (null if none)
+    const ThrowStream * Error() const
+    {
+        return _error.get();
+    }
+
+
+    //! Store a copy of the exception that was raised
+    void SetError(const ThrowStream & ts)
+    {
+        _error.reset(new ThrowStream(ts));
+    }
+
+
+    //! Take ownership of the exception that was raised
+    void SetError(std::unique_ptr<ThrowStream> ts)
+    {
+        _error = std::move(ts);
+    }
+};
+
+
+//! Failure handler that jumps back to the innermost ThrowStreamCheckpoint
+/*!
+ *  If there is no checkpoint, the default handler is used. An exception from
+ *  ThrowStreamRaiser (or copied by ThrowStreamRaise) is moved to the checkpoint;
+ *  any other one is copied.
+ */
+[[noreturn]] inline void ThrowStreamLongjmpHandler(const ThrowStream & ts)
+{
+    ThrowStreamCheckpoint * cp = ThrowStreamCheckpoint::Current();
+    if(cp == nullptr)
+        ThrowStreamAbortHandler(ts);
+
+    std::unique_ptr<ThrowStream> & raised = ThrowStreamRaised();
+    if(raised.get() == &ts)
+        cp->SetError(std::move(raised));
+    else
+        cp->SetError(ts);
+    std::longjmp(cp->env, 1);
+}
+
+#endif //BPLIB_THROWSTREAMNOEXCEPT_H
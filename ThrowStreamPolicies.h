@@ -0,0 +1,203 @@
+/*! \file
+ *  \brief     Other policies for ThrowStreamBasic
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  A ThrowStreamBasic with any of these is its own type. It is thrown with
+ *  <tt>throw</tt> or ThrowStreamRaise rather than the THROWSTREAM macros, and is seen by
+ *  code expecting a ThrowStream as an ordinary std::exception.
+ *
+ *  \code{.cpp}
+ *    typedef ThrowStreamBasic<ThrowStreamFixedStorage<128>, ThrowStreamDeferredFormat,
+ *                             ThrowStreamCompactRender> FastError;
+ *
+ *    throw FastError(THROWSTREAMLOCATION) << "Queue full: " << depth;
+ *  \endcode
+ */
+
+#ifndef BPLIB_THROWSTREAMPOLICIES_H
+#define BPLIB_THROWSTREAMPOLICIES_H
+
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include "ThrowStream.h"
+#include "ThrowStreamImpl.h"
+#include "ThrowStreamVars.h"
+
+
+//! A message held in a fixed-size buffer inside the entry
+/*!
+ *  Adding to the message never allocates. Anything past \p N - 1 characters is dropped.
+ *
+ *  \tparam N Size of the buffer, including the terminating null
+ */
+template<size_t N>
+class ThrowStreamFixedText
+{
+private:
+    char _buf[N];  //!< The message, null-terminated
+    size_t _size;  //!< Length of the message
+
+public:
+    ThrowStreamFixedText() : _size(0)
+    {
+        _buf[0] = 0;
+    }
+
+    //! Replace the message
+    ThrowStreamFixedText & operator=(const char * str)
+    {
+        _size = 0;
+        append(str, strlen(str));
+        return *this;
+    }
+
+    //! Add to the message, dropping whatever doesn't fit
+    void append(const char * data, size_t size)
+    {
+        if(size > N - 1 - _size)
+            size = N - 1 - _size;
+        memcpy(_buf + _size, data, size);
+        _size += size;
+        _buf[_size] = 0;
+    }
+
+    const char * data() const { return _buf; }
+    const char * c_str() const { return _buf; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+};
+
+
+//! Storage policy: messages are kept in a fixed-size buffer (see ThrowStreamFixedText)
+/*!
+ *  The entries themselves are still kept in an std::vector.
+ *
+ *  \tparam N Size of the buffer for each message, including the terminating null
+ */
+template<size_t N>
+struct ThrowStreamFixedStorage
+{
+    typedef ThrowStreamFixedText<N> Text; //!< Holds the message of an entry
+};
+
+
+//! A value added with ThrowStreamDeferredFormat, formatted when the backtrace is rendered
+template<typename T>
+class ThrowStreamDeferredValue : public ThrowStreamDeferred
+{
+private:
+    typename ThrowStreamVarValue<T>::Stored _value; //!< The copied value
+
+public:
+    explicit ThrowStreamDeferredValue(const T & value)
+        : _value(ThrowStreamVarValue<T>::Capture(value))
+    { }
+
+    void Visit(ThrowStreamSegmentFn fn, void * ctx, bool safe) const
+    {
+        ThrowStreamVarValue<T>::Visit(_value, fn, ctx, safe);
+    }
+};
+
+
+//! Format policy: nothing is formatted with a stream when it is added, where that can be avoided
+/*!
+ *  Strings and characters are copied into the message, and integers are written
+ *  directly. Floating-point numbers, enums, and pointers are copied and only
+ *  formatted when the backtrace is rendered (the same as THROWSTREAMVARS), which
+ *  costs a small allocation rather than a stringstream. Anything else is
+ *  formatted with a stringstream when it is added, like ThrowStreamStreamFormat.
+ */
+struct ThrowStreamDeferredFormat
+{
+    //! Add a value to a message
+    /*!
+     *  \param[in,out] ts The exception being added to (for deferred values)
+     *  \param[in,out] text The message of its last entry
+     *  \param[in] value The value to add
+     */
+    template<typename Owner, typename Text, typename T>
+    static void Append(Owner & ts, Text & text, const T & value)
+    {
+        typedef ThrowStreamVarValue<T> V;
+        Append(ts, text, value, std::integral_constant<int, V::Deferred ? (V::Integer ? 2 : 1) : 0>());
+    }
+
+    //! Strings are copied as they are
+    template<typename Owner, typename Text>
+    static void Append(Owner &, Text & text, const char * value)
+    {
+        text.append(value, strlen(value));
+    }
+
+    template<typename Owner, typename Text>
+    static void Append(Owner &, Text & text, const string & value)
+    {
+        text.append(value.data(), value.size());
+    }
+
+    template<typename Owner, typename Text>
+    static void Append(Owner &, Text & text, char value)
+    {
+        text.append(&value, 1);
+    }
+
+
+private:
+    //! Receives the digits of an integer
+    template<typename Text>
+    static void AppendSegment(void * text, const char * data, size_t size)
+    {
+        static_cast<Text *>(text)->append(data, size);
+    }
+
+    //! Anything else is formatted straight away
+    template<typename Owner, typename Text, typename T>
+    static void Append(Owner & ts, Text & text, const T & value, std::integral_constant<int, 0>)
+    {
+        ThrowStreamStreamFormat::Append(ts, text, value);
+    }
+
+    //! Copied, and formatted when rendering
+    template<typename Owner, typename Text, typename T>
+    static void Append(Owner & ts, Text &, const T & value, std::integral_constant<int, 1>)
+    {
+        ts.AddDeferred(std::make_shared<ThrowStreamDeferredValue<T>>(value));
+    }
+
+    //! Integers are written without a stream
+    template<typename Owner, typename Text, typename T>
+    static void Append(Owner &, Text & text, const T & value, std::integral_constant<int, 2>)
+    {
+        typedef ThrowStreamVarValue<T> V;
+        V::Visit(V::Capture(value), &AppendSegment<Text>, &text, false);
+    }
+};
+
+
+//! Render policy: each entry starts with "file:line: ", like a compiler diagnostic
+/*!
+ *  The location is always written, whether or not THROWSTREAM_EXCEPTIONSOURCE is defined.
+ */
+struct ThrowStreamCompactRender
+{
+    //! Write the location of an entry, ahead of its message
+    template<typename Frame>
+    static void VisitLocation(const Frame & f, ThrowStreamSegmentFn fn, void * ctx)
+    {
+        char line[24];
+        fn(ctx, f.file, strlen(f.file));
+        fn(ctx, ":", 1);
+        fn(ctx, line, ThrowStreamFormatUnsigned(line, f.line));
+        if(f.column != 0)
+        {
+            fn(ctx, ":", 1);
+            fn(ctx, line, ThrowStreamFormatUnsigned(line, f.column));
+        }
+        fn(ctx, ": ", 2);
+    }
+};
+
+#endif //BPLIB_THROWSTREAMPOLICIES_H
@@ -0,0 +1,327 @@
+/*! \file
+ *  \brief     Log exceptions from a background thread
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#ifndef BPLIB_THROWSTREAMSINK_H
+#define BPLIB_THROWSTREAMSINK_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "ThrowStream.h"
+
+
+//! Writes exceptions to a stream from a background thread
+/*!
+ *  Submitting an exception only copies its exception_ptr (a reference count
+ *  increment) into a bounded lock-free queue. Rendering with what() and writing
+ *  to the stream both happen on the background thread, so logging doesn't add
+ *  to the latency of the thread that caught the exception.
+ *
+ *  When the queue is full, exceptions are either dropped (and counted) or the
+ *  submitting thread sleeps until there is room, depending on the OverflowPolicy.
+ *
+ *  While the queue is empty, the background thread sleeps. A submitting thread
+ *  only takes a lock to wake it, when it is asleep.
+ *
+ *  \code{.cpp}
+ *    ThrowStreamSink sink(std::cerr);
+ *    ...
+ *    catch(...)
+ *    {
+ *        sink.SubmitCurrent();
+ *    }
+ *  \endcode
+ */
+class ThrowStreamSink
+{
+public:
+    //! What to do when the queue is full
+    enum OverflowPolicy
+    {
+        Drop,  //!< Discard the exception and count it (see Dropped())
+        Block  //!< Sleep until the background thread makes room
+    };
+
+    //! Called regularly on the background thread (see the constructor)
+    /*!
+     *  The second argument is true for the last call, after the queue has been
+     *  emptied when the sink is destroyed.
+     */
+    typedef std::function<void(ostream &, bool)> PeriodicFn;
+
+private:
+    //! A single queue entry
+    /*!
+     *  \p seq tells producers and the consumer whose turn it is to use the slot
+     */
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        std::exception_ptr ptr;
+    };
+
+    ostream & _os;                       //!< Where exceptions are written
+    const OverflowPolicy _policy;        //!< What to do when the queue is full
+    const size_t _mask;                  //!< Queue capacity - 1 (capacity is a power of two)
+    std::unique_ptr<Slot[]> _slots;      //!< The queue
+
+    alignas(64) std::atomic<size_t> _enqueue; //!< Next position to write (shared by producers)
+    alignas(64) size_t _dequeue;              //!< Next position to read (background thread only)
+
+    std::atomic<unsigned long> _dropped; //!< Number of exceptions dropped
+    std::atomic<bool> _stop;             //!< Set when the sink is destroyed
+    std::atomic<bool> _sleeping;         //!< Set while the background thread waits for work
+    std::atomic<unsigned> _blocked;      //!< Number of threads waiting for room (Block policy)
+    std::mutex _mutex;                   //!< Protects waking the background thread or blocked threads
+    std::condition_variable _wake;       //!< Signalled when \p _sleeping is cleared
+    std::condition_variable _room;       //!< Signalled when a slot is freed while threads are blocked
+    const PeriodicFn _periodic;          //!< Called between writes (may be empty)
+    std::thread _thread;                 //!< The background thread
+
+
+    //! Round up to a power of two
+    static size_t Capacity(size_t requested)
+    {
+        size_t c = 2;
+        while(c < requested)
+            c <<= 1;
+        return c;
+    }
+
+
+    //! Render and write a single exception
+    void Write(const std::exception_ptr & ptr)
+    {
+        try
+        {
+            std::rethrow_exception(ptr);
+        }
+        catch(const exception & ex)
+        {
+            _os << ex.what() << '\n';
+        }
+        catch(...)
+        {
+            _os << "Unknown exception\n";
+        }
+        _os.flush();
+    }
+
+
+    //! Take the next entry off the queue, if there is one
+    bool Pop(std::exception_ptr & ptr)
+    {
+        Slot & slot = _slots[_dequeue & _mask];
+        if(slot.seq.load(std::memory_order_acquire) != _dequeue + 1)
+            return false;
+
+        ptr = std::move(slot.ptr);
+        slot.ptr = std::exception_ptr();
+        slot.seq.store(_dequeue + _mask + 1, std::memory_order_seq_cst); // see WaitForRoom
+        _dequeue++;
+
+        if(_blocked.load(std::memory_order_seq_cst) > 0)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _room.notify_all();
+        }
+        return true;
+    }
+
+
+    //! Wait until the background thread frees \p slot, which had \p seq when it was full
+    void WaitForRoom(const Slot & slot, size_t seq)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        // Both this and Pop use seq_cst, so either this sees the slot freed or Pop sees _blocked
+        _blocked.fetch_add(1, std::memory_order_seq_cst);
+        _room.wait(lock, [&slot, seq]() { return slot.seq.load(std::memory_order_seq_cst) != seq; });
+        _blocked.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+
+    //! Wait until something is submitted or the sink is destroyed (or 100 ms, with a periodic function)
+    void Sleep()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        // Both this and Submit use seq_cst, so either this sees the new entry or Submit sees _sleeping
+        _sleeping.store(true, std::memory_order_seq_cst);
+        const bool ready = _slots[_dequeue & _mask].seq.load(std::memory_order_seq_cst) == _dequeue + 1;
+
+        if(!ready && !_stop.load(std::memory_order_acquire))
+        {
+            auto woken = [this]() { return !_sleeping.load(std::memory_order_relaxed); };
+            if(_periodic)
+                _wake.wait_for(lock, std::chrono::milliseconds(100), woken);
+            else
+                _wake.wait(lock, woken);
+        }
+        _sleeping.store(false, std::memory_order_relaxed);
+    }
+
+
+    //! Wake the background thread, if it is asleep
+    void Wake()
+    {
+        if(_sleeping.load(std::memory_order_seq_cst) && _sleeping.exchange(false, std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _wake.notify_one();
+        }
+    }
+
+
+    //! Body of the background thread
+    void Run()
+    {
+        unsigned idle = 0;
+        std::exception_ptr ptr;
+
+        for(;;)
+        {
+            if(_periodic)
+                _periodic(_os, false);
+
+            if(Pop(ptr))
+            {
+                Write(ptr);
+                ptr = std::exception_ptr();
+                idle = 0;
+                continue;
+            }
+
+            // Everything submitted before destruction is now visible
+            if(_stop.load(std::memory_order_acquire))
+            {
+                while(Pop(ptr))
+                {
+                    Write(ptr);
+                    ptr = std::exception_ptr();
+                }
+                if(_periodic)
+                    _periodic(_os, true);
+                break;
+            }
+
+            // Wait briefly for more, then sleep
+            if(++idle < 64)
+                std::this_thread::yield();
+            else
+                Sleep();
+        }
+    }
+
+
+public:
+    //! Start the background thread
+    /*!
+     *  \param[in] os Where the exceptions are written. Only the background thread uses it
+     *  \param[in] capacity Number of exceptions the queue can hold (rounded up to a power of two)
+     *  \param[in] policy What to do when the queue is full
+     *  \param[in] periodic Called on the background thread before each write, and
+     *                      every 100 ms while idle. It may write to \p os as well
+     */
+    explicit ThrowStreamSink(ostream & os, size_t capacity = 1024, OverflowPolicy policy = Drop,
+                             PeriodicFn periodic = PeriodicFn())
+        : _os(os), _policy(policy), _mask(Capacity(capacity) - 1),
+          _slots(new Slot[_mask + 1]), _enqueue(0), _dequeue(0), _dropped(0), _stop(false),
+          _sleeping(false), _blocked(0), _periodic(std::move(periodic))
+    {
+        for(size_t i = 0; i <= _mask; i++)
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+
+        _thread = std::thread(&ThrowStreamSink::Run, this);
+    }
+
+
+    //! Write everything still queued and stop the background thread
+    ~ThrowStreamSink()
+    {
+        _stop.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _sleeping.store(false, std::memory_order_relaxed);
+            _wake.notify_one();
+        }
+        _thread.join();
+    }
+
+    ThrowStreamSink(const ThrowStreamSink &) = delete;
+    ThrowStreamSink & operator=(const ThrowStreamSink &) = delete;
+
+
+    //! Queue an exception to be written. Safe to call from any number of threads
+    /*!
+     *  \param[in] ptr The exception to write
+     *  \return False if the exception was dropped because the queue was full,
+     *          or if \p ptr is null (which is not counted as dropped)
+     */
+    bool Submit(std::exception_ptr ptr)
+    {
+        if(!ptr)
+            return false;
+
+        size_t pos = _enqueue.load(std::memory_order_relaxed);
+
+        for(;;)
+        {
+            Slot & slot = _slots[pos & _mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = std::ptrdiff_t(seq) - std::ptrdiff_t(pos);
+
+            if(diff == 0)
+            {
+                if(_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.ptr = std::move(ptr);
+                    slot.seq.store(pos + 1, std::memory_order_seq_cst); // see Sleep
+                    Wake();
+                    return true;
+                }
+            }
+            else if(diff < 0)
+            {
+                // Full
+                if(_policy == Drop)
+                {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+
+                WaitForRoom(slot, seq);
+                pos = _enqueue.load(std::memory_order_relaxed);
+            }
+            else
+                pos = _enqueue.load(std::memory_order_relaxed);
+        }
+    }
+
+
+    //! Queue the exception currently being handled (from within a catch block)
+    /*!
+     *  Outside of a catch block there is no exception, and false is returned.
+     */
+    bool SubmitCurrent()
+    {
+        return Submit(std::current_exception());
+    }
+
+
+    //! Number of exceptions dropped because the queue was full
+    unsigned long Dropped() const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+};
+
+#endif //BPLIB_THROWSTREAMSINK_H
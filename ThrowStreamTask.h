@@ -0,0 +1,165 @@
+/*! \file
+ *  \brief     Carry the location a task was submitted from into exceptions it throws
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#ifndef BPLIB_THROWSTREAMTASK_H
+#define BPLIB_THROWSTREAMTASK_H
+
+#include <memory>
+#include <utility>
+#include "ThrowStream.h"
+
+
+//! The location a task was submitted from
+/*!
+ *  Only the pointers handed over by the THROWSTREAMTASK macro are stored, so
+ *  nothing is formatted when a task is submitted. If the task was submitted
+ *  from inside another wrapped task, that task's site is kept through \p parent,
+ *  giving the full chain of submitters.
+ */
+struct ThrowStreamTaskSite
+{
+    unsigned long line;    //!< The line the task was submitted from
+    const char * file;     //!< The file the task was submitted from
+    const char * function; //!< The function the task was submitted from
+    std::shared_ptr<const ThrowStreamTaskSite> parent; //!< Site of the enclosing task (may be null)
+};
+
+
+//! The wrapped task currently running on this thread
+/*!
+ *  The shared copy of the site is only made when a task submits another task,
+ *  so tasks that don't submit anything never allocate.
+ */
+struct ThrowStreamTaskRunning
+{
+    const ThrowStreamTaskSite * site; //!< Site of the running task
+    std::shared_ptr<const ThrowStreamTaskSite> shared; //!< Shared copy of \p site, made on demand
+    ThrowStreamTaskRunning * previous; //!< Task that was running before this one on this thread
+};
+
+
+//! Get the innermost wrapped task running on this thread (null if none)
+inline ThrowStreamTaskRunning *& ThrowStreamTaskCurrent()
+{
+    static thread_local ThrowStreamTaskRunning * current = nullptr;
+    return current;
+}
+
+
+//! Get the site of the running task, to be used as the parent of a new task
+inline std::shared_ptr<const ThrowStreamTaskSite> ThrowStreamTaskParent()
+{
+    ThrowStreamTaskRunning * running = ThrowStreamTaskCurrent();
+    if(running == nullptr)
+        return std::shared_ptr<const ThrowStreamTaskSite>();
+
+    if(!running->shared)
+        running->shared = std::make_shared<const ThrowStreamTaskSite>(*running->site);
+    return running->shared;
+}
+
+
+//! A callable that records where it was submitted from
+/*!
+ *  If the wrapped callable throws a ThrowStream, the submitter (and its submitters)
+ *  are appended as new entries in the backtrace, and the exception is rethrown. Any
+ *  other std::exception is copied into a new ThrowStream first.
+ *
+ *  Usually created with the THROWSTREAMTASK macro.
+ */
+template<typename F>
+class ThrowStreamTask
+{
+private:
+    F _f;                      //!< The wrapped callable
+    ThrowStreamTaskSite _site; //!< Where this task was submitted from
+
+
+    //! Appends a chain of submitters to a backtrace, starting at \p site
+    static void AppendSites(ThrowStream & ts, const ThrowStreamTaskSite * site)
+    {
+        for(; site != nullptr; site = site->parent.get())
+            ts.Append(ThrowStreamLocation(site->line, site->file, site->function)) << "Task submitted from here";
+    }
+
+
+    //! Makes this task the current one on this thread for its lifetime
+    struct RunningGuard
+    {
+        ThrowStreamTaskRunning running;
+
+        RunningGuard(const ThrowStreamTaskSite & site)
+        {
+            running.site = &site;
+            running.previous = ThrowStreamTaskCurrent();
+            ThrowStreamTaskCurrent() = &running;
+        }
+
+        ~RunningGuard()
+        {
+            ThrowStreamTaskCurrent() = running.previous;
+        }
+    };
+
+
+public:
+    //! Wrap a callable, capturing the submitter's location
+    /*!
+     *  \param[in] f The callable to wrap
+     *  \param[in] line The line the task is submitted from
+     *  \param[in] file The file the task is submitted from
+     *  \param[in] function The function the task is submitted from
+     */
+    ThrowStreamTask(F f, unsigned long line, const char * file, const char * function)
+        : _f(std::move(f))
+    {
+        _site.line = line;
+        _site.file = file;
+        _site.function = function;
+        _site.parent = ThrowStreamTaskParent();
+    }
+
+
+    //! Run the wrapped callable
+    template<typename... Args>
+    auto operator()(Args &&... args) -> decltype(_f(std::forward<Args>(args)...))
+    {
+        RunningGuard guard(_site);
+
+        try
+        {
+            return _f(std::forward<Args>(args)...);
+        }
+        catch(ThrowStream & ts)
+        {
+            AppendSites(ts, &_site);
+            throw;
+        }
+        catch(const ThrowStreamCancelled &)
+        {
+            // Kept cheap, and with its type, so it can be told apart from the first error
+            throw;
+        }
+        catch(const exception & ex)
+        {
+            ThrowStream ts(ex, ThrowStreamLocation(_site.line, _site.file, _site.function));
+            ts << "Task submitted from here";
+            AppendSites(ts, _site.parent.get());
+            throw ts;
+        }
+    }
+};
+
+
+//! Create a ThrowStreamTask (see THROWSTREAMTASK)
+template<typename F>
+ThrowStreamTask<typename std::decay<F>::type>
+ThrowStreamMakeTask(F && f, unsigned long line, const char * file, const char * function)
+{
+    return ThrowStreamTask<typename std::decay<F>::type>(std::forward<F>(f), line, file, function);
+}
+
+#endif //BPLIB_THROWSTREAMTASK_H
@@ -0,0 +1,159 @@
+/*! \file
+ *  \brief     A terminate handler that prints uncaught ThrowStreams (POSIX only)
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#ifndef BPLIB_THROWSTREAMTERMINATE_H
+#define BPLIB_THROWSTREAMTERMINATE_H
+
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include "ThrowStream.h"
+#include "ThrowStreamFd.h"
+
+
+//! Called by the terminate handler before aborting, to dump any other state
+/*!
+ *  For example, an application can dump its own in-memory logs from here.
+ *  The heap may be corrupted, so this should avoid allocating.
+ *
+ *  \param[in] fd The file descriptor the handler is writing to
+ */
+typedef void (*ThrowStreamTerminateHook)(int fd);
+
+
+//! Settings used by ThrowStreamTerminateHandler
+struct ThrowStreamTerminateSettings
+{
+    int fd;                        //!< Where to write
+    ThrowStreamTerminateHook hook; //!< Called before aborting (may be null)
+    std::atomic<bool> active;      //!< Set once the handler has started
+};
+
+
+//! Get the settings used by ThrowStreamTerminateHandler
+inline ThrowStreamTerminateSettings & ThrowStreamTerminateConfig()
+{
+    static ThrowStreamTerminateSettings settings = { 2, nullptr, { false } };
+    return settings;
+}
+
+
+//! Write a single exception (but not what it wraps) for the terminate handler
+/*!
+ *  \return The exception nested inside this one (null if none)
+ */
+inline std::exception_ptr ThrowStreamTerminateWrite(ThrowStreamSafeWriter & w, const std::exception_ptr & ptr)
+{
+    std::exception_ptr nested;
+
+    try
+    {
+        std::rethrow_exception(ptr);
+    }
+    catch(const ThrowStream & ts)
+    {
+        ts.ForEachSegment(w, true);
+
+        // It may also have been thrown with std::throw_with_nested
+        try
+        {
+            std::rethrow_exception(ptr);
+        }
+        catch(const std::nested_exception & ne)
+        {
+            nested = ne.nested_ptr();
+        }
+        catch(...)
+        {
+        }
+        return nested;
+    }
+    catch(const std::nested_exception & ne)
+    {
+        nested = ne.nested_ptr();
+    }
+    catch(...)
+    {
+    }
+
+    // Anything other than a ThrowStream. Without RTTI, the only way to
+    // get the description is to catch it again as an std::exception
+    try
+    {
+        std::rethrow_exception(ptr);
+    }
+    catch(const exception & ex)
+    {
+        w("\n");
+        w(ex.what());
+    }
+    catch(...)
+    {
+        w("\nUnknown exception (not derived from std::exception)");
+    }
+
+    return nested;
+}
+
+
+//! Terminate handler that prints the uncaught exception before aborting
+/*!
+ *  ThrowStreams are written with the same stack-buffer and write() path as
+ *  ThrowStreamRenderToFd, and exceptions nested with std::throw_with_nested are
+ *  followed. The hook (if any) is then called, and the program aborts.
+ *
+ *  Rethrowing the exception to examine it is the only step that may allocate;
+ *  libstdc++ falls back to its emergency pool if that fails.
+ */
+[[noreturn]] inline void ThrowStreamTerminateHandler()
+{
+    ThrowStreamTerminateSettings & settings = ThrowStreamTerminateConfig();
+
+    // Terminating again from inside the handler
+    if(settings.active.exchange(true))
+        std::abort();
+
+    ThrowStreamSafeWriter w(settings.fd);
+    std::exception_ptr ptr = std::current_exception();
+
+    if(ptr)
+    {
+        w("\nterminate called after throwing an exception:");
+        for(int depth = 0; ptr && depth < 32; depth++)
+        {
+            if(depth > 0)
+                w("\ncaused by:");
+            ptr = ThrowStreamTerminateWrite(w, ptr);
+        }
+    }
+    else
+        w("\nterminate called without an active exception");
+
+    w("\n");
+    w.Flush();
+
+    if(settings.hook != nullptr)
+        settings.hook(settings.fd);
+
+    std::abort();
+}
+
+
+//! Install ThrowStreamTerminateHandler with std::set_terminate
+/*!
+ *  \param[in] hook Called before aborting, to dump any other state (may be null)
+ *  \param[in] fd Where to write
+ *  \return The previous terminate handler
+ */
+inline std::terminate_handler ThrowStreamInstallTerminateHandler(ThrowStreamTerminateHook hook = nullptr, int fd = 2)
+{
+    ThrowStreamTerminateSettings & settings = ThrowStreamTerminateConfig();
+    settings.fd = fd;
+    settings.hook = hook;
+    return std::set_terminate(&ThrowStreamTerminateHandler);
+}
+
+#endif //BPLIB_THROWSTREAMTERMINATE_H
@@ -0,0 +1,247 @@
+/*! \file
+ *  \brief     Add the names and values of variables to a ThrowStream in one step
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#ifndef BPLIB_THROWSTREAMVARS_H
+#define BPLIB_THROWSTREAMVARS_H
+
+#include <memory>
+#include <sstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ThrowStream.h"
+
+
+//! The names of the variables passed to one use of THROWSTREAMVARS
+/*!
+ *  Built once from the stringified argument list, and shared by every
+ *  exception thrown from that place.
+ */
+class ThrowStreamVarLayout
+{
+private:
+    std::vector<std::pair<const char *, size_t>> _names; //!< Each name (not null-terminated)
+
+public:
+    //! Split a stringified argument list into names
+    /*!
+     *  Only commas outside of brackets and quotes separate names.
+     *
+     *  \param[in] names The argument list, which must outlive this object (normally a literal)
+     */
+    explicit ThrowStreamVarLayout(const char * names)
+    {
+        const char * start = names;
+        int depth = 0;
+        char quote = 0;
+
+        for(const char * p = names; ; p++)
+        {
+            if(quote != 0)
+            {
+                if(*p == '\\' && p[1] != 0)
+                    p++;
+                else if(*p == quote)
+                    quote = 0;
+                else if(*p == 0)
+                    break;
+                continue;
+            }
+
+            if(*p == '"' || *p == '\'')
+                quote = *p;
+            else if(*p == '(' || *p == '[' || *p == '{')
+                depth++;
+            else if(*p == ')' || *p == ']' || *p == '}')
+                depth--;
+            else if((*p == ',' && depth == 0) || *p == 0)
+            {
+                const char * end = p;
+                while(start < end && (*start == ' ' || *start == '\t' || *start == '\n'))
+                    start++;
+                while(end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n'))
+                    end--;
+                _names.push_back(std::make_pair(start, size_t(end - start)));
+
+                if(*p == 0)
+                    break;
+                start = p + 1;
+            }
+        }
+    }
+
+
+    //! Write one of the names (or "?" if there aren't that many)
+    void VisitName(size_t i, ThrowStreamSegmentFn fn, void * ctx) const
+    {
+        if(i < _names.size())
+            fn(ctx, _names[i].first, _names[i].second);
+        else
+            fn(ctx, "?", 1);
+    }
+};
+
+
+//! How THROWSTREAMVARS stores a value of type T
+/*!
+ *  Numbers, enums, and pointers (other than strings) are copied as they are, and are
+ *  only formatted when the backtrace is rendered. Anything else may refer to memory
+ *  that is gone by then (a string_view, for example), so it is formatted straight away.
+ */
+template<typename T>
+struct ThrowStreamVarValue
+{
+    typedef typename std::remove_cv<T>::type Plain;
+    typedef typename std::remove_cv<typename std::remove_pointer<Plain>::type>::type Pointee;
+
+    //! Is the type one of the character types (which stream as characters, not numbers)?
+    static const bool IsChar = std::is_same<Pointee, char>::value ||
+                               std::is_same<Pointee, signed char>::value ||
+                               std::is_same<Pointee, unsigned char>::value ||
+                               std::is_same<Pointee, wchar_t>::value ||
+                               std::is_same<Pointee, char16_t>::value ||
+                               std::is_same<Pointee, char32_t>::value;
+
+    //! Is the value copied and formatted later?
+    static const bool Deferred = !IsChar && (std::is_arithmetic<Plain>::value ||
+                                             std::is_enum<Plain>::value ||
+                                             std::is_pointer<Plain>::value);
+
+    //! Is the value an integer, which can be formatted without a stream?
+    static const bool Integer = std::is_integral<Plain>::value && !std::is_same<Plain, bool>::value;
+
+    //! What is stored
+    typedef typename std::conditional<Deferred, Plain, string>::type Stored;
+
+
+    //! Store a value
+    static Stored Capture(const T & value)
+    {
+        return Capture(value, std::integral_constant<bool, Deferred>());
+    }
+
+    //! Write a stored value
+    static void Visit(const Stored & value, ThrowStreamSegmentFn fn, void * ctx, bool safe)
+    {
+        Visit(value, fn, ctx, safe, std::integral_constant<int, Deferred ? (Integer ? 2 : 1) : 0>());
+    }
+
+
+private:
+    static Stored Capture(const T & value, std::true_type)
+    {
+        return value;
+    }
+
+    static Stored Capture(const T & value, std::false_type)
+    {
+        stringstream ss;
+        ss << value;
+        return ss.str();
+    }
+
+
+    //! Formatted when captured
+    static void Visit(const Stored & value, ThrowStreamSegmentFn fn, void * ctx, bool, std::integral_constant<int, 0>)
+    {
+        fn(ctx, value.data(), value.size());
+    }
+
+    //! Needs a stream, which isn't safe in a signal handler
+    static void Visit(const Stored & value, ThrowStreamSegmentFn fn, void * ctx, bool safe, std::integral_constant<int, 1>)
+    {
+        if(safe)
+        {
+            fn(ctx, "?", 1);
+            return;
+        }
+
+        stringstream ss;
+        ss << value;
+        const string str = ss.str();
+        ThrowStreamVisitTemporary(fn, ctx, str.data(), str.size());
+    }
+
+    //! Integers are formatted directly (the same as a stream with default flags)
+    static void Visit(const Stored & value, ThrowStreamSegmentFn fn, void * ctx, bool, std::integral_constant<int, 2>)
+    {
+        char digits[24];
+        if(value < Stored(0))
+        {
+            fn(ctx, "-", 1);
+            fn(ctx, digits, ThrowStreamFormatUnsigned(digits, 0ULL - (unsigned long long)value));
+        }
+        else
+            fn(ctx, digits, ThrowStreamFormatUnsigned(digits, (unsigned long long)value));
+    }
+};
+
+
+//! The captured values of the variables passed to THROWSTREAMVARS
+template<typename... Ts>
+struct ThrowStreamVarList;
+
+
+template<>
+struct ThrowStreamVarList<>
+{
+    void Visit(const ThrowStreamVarLayout &, size_t, ThrowStreamSegmentFn, void *, bool) const
+    { }
+};
+
+
+template<typename T, typename... Rest>
+struct ThrowStreamVarList<T, Rest...>
+{
+    typename ThrowStreamVarValue<T>::Stored value;
+    ThrowStreamVarList<Rest...> rest;
+
+    ThrowStreamVarList(const T & v, const Rest &... r)
+        : value(ThrowStreamVarValue<T>::Capture(v)), rest(r...)
+    { }
+
+    //! Write "name=value" for this variable and the rest
+    void Visit(const ThrowStreamVarLayout & layout, size_t i, ThrowStreamSegmentFn fn, void * ctx, bool safe) const
+    {
+        if(i > 0)
+            fn(ctx, " ", 1);
+        layout.VisitName(i, fn, ctx);
+        fn(ctx, "=", 1);
+        ThrowStreamVarValue<T>::Visit(value, fn, ctx, safe);
+        rest.Visit(layout, i + 1, fn, ctx, safe);
+    }
+};
+
+
+//! Names and values added with THROWSTREAMVARS
+template<typename... Ts>
+class ThrowStreamVars : public ThrowStreamDeferred
+{
+private:
+    const ThrowStreamVarLayout & _layout; //!< The names (static, one per use of the macro)
+    ThrowStreamVarList<Ts...> _values;    //!< The values
+
+public:
+    ThrowStreamVars(const ThrowStreamVarLayout & layout, const Ts &... values)
+        : _layout(layout), _values(values...)
+    { }
+
+    void Visit(ThrowStreamSegmentFn fn, void * ctx, bool safe) const
+    {
+        _values.Visit(_layout, 0, fn, ctx, safe);
+    }
+};
+
+
+//! Capture values for THROWSTREAMVARS
+template<typename... Ts>
+ThrowStreamDeferredRef ThrowStreamMakeVars(const ThrowStreamVarLayout & layout, const Ts &... values)
+{
+    ThrowStreamDeferredRef ref = { std::make_shared<ThrowStreamVars<Ts...>>(layout, values...) };
+    return ref;
+}
+
+#endif //BPLIB_THROWSTREAMVARS_H
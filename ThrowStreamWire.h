@@ -0,0 +1,435 @@
+/*! \file
+ *  \brief     Sending a ThrowStream to another process (ThrowStream::Serialize and Deserialize)
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  Like ThrowStreamImpl.h, this is compiled once for ThrowStream (see THROWSTREAM_IMPLEMENTATION).
+ *  Code serializing a ThrowStreamBasic with policies other than the defaults should include it.
+ */
+
+#ifndef BPLIB_THROWSTREAMWIRE_H
+#define BPLIB_THROWSTREAMWIRE_H
+
+#include <map>
+#include <mutex>
+#include "ThrowStream.h"
+#include "ThrowStreamImpl.h"
+
+
+/*
+ * The binary format written by ThrowStream::Serialize (version 1)
+ *
+ *   "TSB", version byte, then the entries:
+ *
+ *   entries:  count, then for each entry a flags byte (1 = external, 2 = signature,
+ *             4 = error code, 8 = aggregated exceptions) and
+ *               external:  description (string)
+ *               otherwise: line, column, file (string), function (string),
+ *                          message (chunks: length and bytes, ending with a length of 0),
+ *                          [error code: value (zigzag), category name, message (strings)],
+ *                          [aggregated: count, then for each a kind byte
+ *                           (1 = ThrowStream, followed by its entries;
+ *                            2 = other exception, followed by its description;
+ *                            plus 0x80 if a label (string) comes first)]
+ *
+ *   Numbers are unsigned LEB128 varints. Strings are a length and then the bytes.
+ */
+static const unsigned char ThrowStreamWireVersion = 1;
+
+
+//! Writes the binary format into a fixed buffer, counting whatever doesn't fit
+class ThrowStreamWireWriter
+{
+private:
+    unsigned char * _buf; //!< Where to write
+    size_t _size;         //!< Size of \p _buf
+    size_t _pos;          //!< Bytes written so far (including those that didn't fit)
+
+public:
+    ThrowStreamWireWriter(void * buf, size_t size)
+        : _buf(static_cast<unsigned char *>(buf)), _size(size), _pos(0)
+    { }
+
+    void Bytes(const void * data, size_t size)
+    {
+        if(_pos < _size)
+            memcpy(_buf + _pos, data, (size < _size - _pos) ? size : _size - _pos);
+        _pos += size;
+    }
+
+    void Byte(unsigned char b)
+    {
+        Bytes(&b, 1);
+    }
+
+    void Varint(unsigned long long value)
+    {
+        unsigned char tmp[10];
+        size_t n = 0;
+        while(value >= 0x80)
+        {
+            tmp[n++] = (unsigned char)(value | 0x80);
+            value >>= 7;
+        }
+        tmp[n++] = (unsigned char)value;
+        Bytes(tmp, n);
+    }
+
+    void String(const char * str, size_t size)
+    {
+        Varint(size);
+        Bytes(str, size);
+    }
+
+    void String(const char * str)
+    {
+        String(str, strlen(str));
+    }
+
+    //! Write a segment as one chunk of a message
+    static void Chunk(void * self, const char * data, size_t size)
+    {
+        if(size == 0)
+            return;
+        ThrowStreamWireWriter * w = static_cast<ThrowStreamWireWriter *>(self);
+        w->Varint(size);
+        w->Bytes(data, size);
+    }
+
+    //! Total size of what has been written
+    size_t Size() const
+    {
+        return _pos;
+    }
+};
+
+
+//! Reads the binary format, throwing a ThrowStream if it is malformed
+class ThrowStreamWireReader
+{
+private:
+    const unsigned char * _begin; //!< Start of the data
+    const unsigned char * _pos;   //!< Next byte to read
+    const unsigned char * _end;   //!< End of the data
+
+public:
+    ThrowStreamWireReader(const void * buf, size_t size)
+        : _begin(static_cast<const unsigned char *>(buf)), _pos(_begin), _end(_begin + size)
+    { }
+
+    [[noreturn]] void Fail(const char * problem) const
+    {
+        ThrowStreamRaise(ThrowStream(THROWSTREAMLOCATION) << "Malformed ThrowStream data ("
+                         << problem << ") at byte " << (unsigned long)(_pos - _begin));
+    }
+
+    size_t Remaining() const
+    {
+        return size_t(_end - _pos);
+    }
+
+    const char * Bytes(size_t size)
+    {
+        if(size > Remaining())
+            Fail("truncated");
+        const char * p = reinterpret_cast<const char *>(_pos);
+        _pos += size;
+        return p;
+    }
+
+    unsigned char Byte()
+    {
+        return static_cast<unsigned char>(*Bytes(1));
+    }
+
+    unsigned long long Varint()
+    {
+        unsigned long long value = 0;
+        for(int shift = 0; shift < 64; shift += 7)
+        {
+            unsigned char b = Byte();
+            value |= (unsigned long long)(b & 0x7f) << shift;
+            if((b & 0x80) == 0)
+                return value;
+        }
+        Fail("bad number");
+    }
+
+    //! Read a count of things that each take at least one byte
+    size_t Count()
+    {
+        unsigned long long n = Varint();
+        if(n > Remaining())
+            Fail("bad count");
+        return size_t(n);
+    }
+
+    string String()
+    {
+        size_t size = Count();
+        return string(Bytes(size), size);
+    }
+};
+
+
+//! Get an error category for a code read by Deserialize
+/*!
+ *  The generic and system categories are the ones in this process. Others can't be
+ *  found by name, so they are replaced by a category with the same name that
+ *  remembers the messages that were sent.
+ */
+THROWSTREAM_COLD const std::error_category & ThrowStreamWireCategory(const string & name, int value,
+                                                                     const string & message);
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+void ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::WriteWire(ThrowStreamWireWriter & w) const
+{
+    w.Varint(_frames.size());
+
+    for(size_t i = 0; i < _frames.size(); i++)
+    {
+        const Frame & f = _frames[i];
+        w.Byte((unsigned char)((f.external ? 1 : 0) | (f.signature ? 2 : 0) |
+                               (f.errorCategory != nullptr ? 4 : 0) | (f.children ? 8 : 0)));
+
+        if(f.external)
+        {
+            w.String(f.ExternalWhat());
+            continue;
+        }
+
+        w.Varint(f.line);
+        w.Varint(f.column);
+        w.String(f.file);
+        w.String(f.function);
+
+        VisitMessage(f, &ThrowStreamWireWriter::Chunk, &w, false);
+        w.Varint(0);
+
+        if(f.errorCategory != nullptr)
+        {
+            unsigned long long v = (unsigned long long)(long long)f.errorValue;
+            w.Varint((v << 1) ^ (f.errorValue < 0 ? ~0ULL : 0ULL));
+            w.String(f.errorCategory->name());
+            const string msg = f.errorCategory->message(f.errorValue);
+            w.String(msg.data(), msg.size());
+        }
+
+        if(f.children)
+        {
+            const std::vector<ThrowStreamChild> & children = *f.children;
+            w.Varint(children.size());
+            for(size_t j = 0; j < children.size(); j++)
+            {
+                const ThrowStreamChild & child = children[j];
+                w.Byte((unsigned char)(((child.ts != nullptr) ? 1 : 2) | (child.label ? 0x80 : 0)));
+                if(child.label)
+                    w.String(child.label->data(), child.label->size());
+
+                if(child.ts != nullptr)
+                    child.ts->WriteWire(w);
+                else
+                    w.String((child.ex != nullptr) ? child.ex->what() : "Unknown exception");
+            }
+        }
+    }
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+void ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::ReadWire(ThrowStreamWireReader & r, int depth)
+{
+    if(depth > 64)
+        r.Fail("nested too deeply");
+
+    size_t count = r.Count();
+    if(count == 0)
+        r.Fail("no entries");
+    _frames.reserve(count);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        Frame f;
+        unsigned char flags = r.Byte();
+        if(flags > 15)
+            r.Fail("unknown flags");
+
+        if(flags & 1)
+        {
+            const string what = r.String();
+            f.external = true;
+            f.message.append(what.data(), what.size());
+            PushFrame(std::move(f));
+            continue;
+        }
+
+        f.line = (unsigned long)r.Varint();
+        f.column = (unsigned long)r.Varint();
+        const string file = r.String();
+        const string function = r.String();
+        f.names = CopyNames(file, function);
+        f.file = f.names->c_str();
+        f.function = f.names->c_str() + file.size() + 1;
+        f.signature = (flags & 2) != 0;
+
+        for(size_t n = r.Count(); n != 0; n = r.Count())
+            f.message.append(r.Bytes(n), n);
+
+        if(flags & 4)
+        {
+            unsigned long long v = r.Varint();
+            f.errorValue = (int)(long long)((v >> 1) ^ (0ULL - (v & 1)));
+            const string name = r.String();
+            const string msg = r.String();
+            f.errorCategory = &ThrowStreamWireCategory(name, f.errorValue, msg);
+        }
+
+        if(flags & 8)
+        {
+            std::shared_ptr<std::vector<ThrowStreamChild>> children = std::make_shared<std::vector<ThrowStreamChild>>();
+            size_t n = r.Count();
+            for(size_t j = 0; j < n; j++)
+            {
+                ThrowStream ts;
+                std::shared_ptr<const string> label;
+                unsigned char kind = r.Byte();
+                if(kind & 0x80)
+                {
+                    label = std::make_shared<const string>(r.String());
+                    kind &= 0x7f;
+                }
+
+                if(kind == 1)
+                    ts.ReadWire(r, depth + 1);
+                else if(kind == 2)
+                {
+                    const string what = r.String();
+                    typename ThrowStream::Frame ef;
+                    ef.external = true;
+                    ef.message = what;
+                    ts.PushFrame(std::move(ef));
+                }
+                else
+                    r.Fail("unknown kind of aggregated exception");
+
+                ThrowStreamChild child;
+                child.label = std::move(label);
+#ifdef THROWSTREAM_EXCEPTIONS
+                // The child must be held by an exception_ptr, like those from AggregateThrowStream
+                child.ptr = std::make_exception_ptr(std::move(ts));
+                try
+                {
+                    std::rethrow_exception(child.ptr);
+                }
+                catch(const ThrowStream & held)
+                {
+                    child.ex = &held;
+                    child.ts = &held;
+                }
+#else
+                // There are no exception_ptrs without exceptions, so it is shared instead
+                child.held.reset(new ThrowStream(std::move(ts)));
+                child.ex = child.held.get();
+                child.ts = child.held.get();
+#endif
+                children->push_back(child);
+            }
+            f.children = std::move(children);
+        }
+
+        PushFrame(std::move(f));
+    }
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+size_t ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::Serialize(void * buf, size_t size) const
+{
+    ThrowStreamWireWriter w(buf, size);
+    w.Bytes("TSB", 3);
+    w.Byte(ThrowStreamWireVersion);
+    WriteWire(w);
+    return w.Size();
+}
+
+
+template<typename StoragePolicy, typename FormatPolicy, typename RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>
+ThrowStreamBasic<StoragePolicy, FormatPolicy, RenderPolicy>::Deserialize(const void * buf, size_t size)
+{
+    ThrowStreamWireReader r(buf, size);
+    if(memcmp(r.Bytes(3), "TSB", 3) != 0)
+        r.Fail("not ThrowStream data");
+    if(r.Byte() != ThrowStreamWireVersion)
+        r.Fail("unsupported version");
+
+    ThrowStreamBasic ts;
+    ts.ReadWire(r, 0);
+    if(r.Remaining() != 0)
+        r.Fail("trailing data");
+    return ts;
+}
+
+
+// These are defined once, in the library or the file defining THROWSTREAM_IMPLEMENTATION
+#ifdef THROWSTREAM_IMPLEMENTATION_FILE
+
+//! An error category from another process, known only by its name (see ThrowStreamWireCategory)
+class ThrowStreamRemoteCategory : public std::error_category
+{
+private:
+    const string _name;                 //!< The name
+    mutable std::mutex _mtx;            //!< Protects \p _messages
+    std::map<int, string> _messages;    //!< The latest message received for each value
+
+public:
+    explicit ThrowStreamRemoteCategory(const string & name) : _name(name) { }
+
+    const char * name() const noexcept
+    {
+        return _name.c_str();
+    }
+
+    string message(int value) const
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        std::map<int, string>::const_iterator it = _messages.find(value);
+        return (it != _messages.end()) ? it->second : string("Unknown error");
+    }
+
+    void SetMessage(int value, const string & message)
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _messages[value] = message;
+    }
+};
+
+
+THROWSTREAM_COLD const std::error_category & ThrowStreamWireCategory(const string & name, int value,
+                                                                     const string & message)
+{
+    static std::mutex mtx;
+    static std::map<string, ThrowStreamRemoteCategory *> * table =
+        new std::map<string, ThrowStreamRemoteCategory *>; // never destroyed, like the categories
+
+    if(name == std::generic_category().name())
+        return std::generic_category();
+    if(name == std::system_category().name())
+        return std::system_category();
+
+    ThrowStreamRemoteCategory * cat;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ThrowStreamRemoteCategory *& entry = (*table)[name];
+        if(entry == nullptr)
+            entry = new ThrowStreamRemoteCategory(name);
+        cat = entry;
+    }
+    cat->SetMessage(value, message);
+    return *cat;
+}
+
+#endif
+
+#endif //BPLIB_THROWSTREAMWIRE_H
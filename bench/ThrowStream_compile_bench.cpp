@@ -0,0 +1,48 @@
+/*
+   A file with four throw sites, used by compile_bench.sh to measure what including
+   ThrowStream costs each file (compile time, code size, and static initializers).
+   Copyright 2013 Benjamin Pritchard
+   Relased under the MIT License
+*/
+
+#include <string>
+#include "ThrowStream.h"
+
+using std::string;
+
+
+double Inverse(int i)
+{
+    if(i == 0)
+        THROWSTREAM << "Can't take the inverse of " << i;
+    return 1.0/double(i);
+}
+
+
+double Ratio(double a, double b)
+{
+    if(b == 0.0)
+        THROWSTREAM << "Can't divide " << a << " by zero";
+    return a/b;
+}
+
+
+unsigned long Lookup(const string & key, unsigned long size)
+{
+    if(key.empty())
+        THROWSTREAM << "Empty key (table has " << size << " entries)";
+    return key.size() % size;
+}
+
+
+double Combine(int i, double a, const string & key)
+{
+    try
+    {
+        return Inverse(i) * Ratio(a, double(Lookup(key, 16)));
+    }
+    catch(exception & ex)
+    {
+        THROWSTREAMAPPEND(ex) << "While combining " << key;
+    }
+}
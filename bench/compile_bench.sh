@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# Measures what ThrowStream costs each file that uses it: compile time, size of
+# .text, and the number of static initializers (which run at startup).
+#
+#   bench/compile_bench.sh [runs] [git-ref]
+#
+# ThrowStream_compile_bench.cpp is compiled with $CXX -O2 (default g++), runs times
+# (default 20): as any file that throws, and as the one file of the program that
+# defines THROWSTREAM_IMPLEMENTATION. If a git ref is given, the headers from that
+# commit are measured as well, as "before". The original header is ea2e54e:
+#
+#   bench/compile_bench.sh 5 ea2e54e
+
+set -e
+
+runs=${1:-20}
+ref=$2
+cxx=${CXX:-g++}
+root=$(cd "$(dirname "$0")/.." && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+
+# measure label include-dir [flags...]
+measure()
+{
+    label=$1
+    inc=$2
+    shift 2
+
+    start=$(date +%s%N)
+    i=0
+    while [ "$i" -lt "$runs" ]; do
+        "$cxx" -std=c++11 -O2 -DTHROWSTREAM_EXCEPTIONSOURCE "$@" -I"$inc" \
+               -c "$root/bench/ThrowStream_compile_bench.cpp" -o "$tmp/bench.o"
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+
+    ms=$(( (end - start) / 1000000 / runs ))
+    text=$(size -A "$tmp/bench.o" | awk '$1 ~ /^\.text/ { s += $2 } END { print s + 0 }')
+    init=$(nm "$tmp/bench.o" | grep -c '_GLOBAL__sub_I' || true)
+    printf '%-16s %5d ms/TU   .text %6d bytes   %d static initializers\n' "$label:" "$ms" "$text" "$init"
+}
+
+
+echo "$cxx -O2, four throw sites, $runs runs each:"
+
+if [ -n "$ref" ]; then
+    mkdir "$tmp/before"
+    git -C "$root" archive "$ref" | tar -x -C "$tmp/before"
+    measure before "$tmp/before"
+fi
+
+measure header-only "$root"
+measure implementation "$root" -DTHROWSTREAM_IMPLEMENTATION
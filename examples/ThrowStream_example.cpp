@@ -7,7 +7,11 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+
+// ThrowStream is compiled in this file (unless linking to the throwstream library)
+#define THROWSTREAM_IMPLEMENTATION
 #include "ThrowStream.h"
+#include "ThrowStreamVars.h"
 
 using std::string;
 using std::cout;
@@ -31,8 +35,7 @@ double MultiplyInverse(double a, int b)
     }
     catch(exception & ex)
     {
-        THROWSTREAMAPPEND(ex) << "Called from MultiplyInverse: a = "
-                              << a << " b = " << b;
+        THROWSTREAMAPPEND(ex) << "Called from MultiplyInverse: " << THROWSTREAMVARS(a, b);
     }
 }
 
@@ -0,0 +1,104 @@
+/*
+   An example of gathering the exceptions from several worker processes.
+   Copyright 2013 Benjamin Pritchard
+   Relased under the MIT License
+*/
+
+#include <iostream>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ThrowStream is compiled in this file (unless linking to the throwstream library)
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStream.h"
+#include "ThrowStreamGather.h"
+
+using std::cout;
+using std::exception;
+using std::vector;
+
+
+double Inverse(int i)
+{
+    if(i == 0)
+        THROWSTREAM << "Error: I can't take the inverse of 0!";
+
+    return 1.0/double(i);
+}
+
+
+// The work done by each rank. A few of them get bad input
+double Work(int rank)
+{
+    int value = (rank % 4 == 3) ? 0 : rank + 1;
+
+    try {
+        return Inverse(value);
+    }
+    catch(const exception & ex)
+    {
+        THROWSTREAMAPPEND(ex) << "Working on rank " << rank << "'s input";
+    }
+}
+
+
+int main()
+{
+    const int nranks = 16;
+    vector<int> fds;
+
+    for(int rank = 0; rank < nranks; rank++)
+    {
+        int p[2];
+        if(pipe(p) != 0)
+            THROWSTREAMERRNO << "Creating a pipe";
+
+        pid_t pid = fork();
+        if(pid < 0)
+            THROWSTREAMERRNO << "Starting rank " << rank;
+
+        if(pid == 0)
+        {
+            // Worker: send any exception to the coordinator, then exit
+            close(p[0]);
+            for(size_t i = 0; i < fds.size(); i++)
+                close(fds[i]);
+
+            int status = 0;
+            try {
+                Work(rank);
+            }
+            catch(const ThrowStream & ex)
+            {
+                ThrowStreamSend(p[1], ex, rank);
+                status = 1;
+            }
+            close(p[1]);
+            _exit(status);
+        }
+
+        close(p[1]);
+        fds.push_back(p[0]);
+    }
+
+    try {
+        ThrowStreamGather gather;
+        gather.Receive(fds);
+
+        for(size_t i = 0; i < fds.size(); i++)
+            close(fds[i]);
+        while(wait(nullptr) > 0)
+            ;
+
+        // Rather than 4 copies of the same backtrace, this prints one, labelled with the ranks
+        if(!gather.Empty())
+            THROWSTREAMAGGREGATE(gather) << gather.Ranks() << " of " << nranks << " ranks failed";
+    }
+    catch(const ThrowStream & ex)
+    {
+        cout << "\nError! " << ex << "\n\n";
+    }
+
+    return 0;
+}
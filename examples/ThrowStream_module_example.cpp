@@ -0,0 +1,48 @@
+/*
+   An example of using ThrowStream through the C++20 module (experimental, see
+   ThrowStream.cppm).
+   Copyright 2013 Benjamin Pritchard
+   Relased under the MIT License
+*/
+
+#include <iostream>
+#include "ThrowStreamMacros.h"
+import throwstream;
+
+using std::cout;
+
+
+double Inverse(int i)
+{
+    if(i == 0)
+        THROWSTREAM << "Error: I can't take the inverse of 0!";
+
+    return 1.0/double(i);
+}
+
+
+double MultiplyInverse(int a, int b)
+{
+    try {
+        return a * Inverse(b);
+    }
+    catch(const ThrowStream & ex)
+    {
+        THROWSTREAMAPPEND(ex) << "Called from MultiplyInverse: " << THROWSTREAMVARS(a, b);
+    }
+}
+
+
+int main()
+{
+    try {
+        cout << "\n2 * 1/4 = " << MultiplyInverse(2, 4) << "\n";
+        cout << "\n2 * 1/0 = " << MultiplyInverse(2, 0) << "\n";
+    }
+    catch(const ThrowStream & ex)
+    {
+        cout << "\n\nError! " << ex << "\n\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+   An example of using the ThrowStream macros in code built without exceptions.
+   Copyright 2013 Benjamin Pritchard
+   Relased under the MIT License
+*/
+
+#include <iostream>
+
+// ThrowStream is compiled in this file (unless linking to the throwstream library)
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStream.h"
+
+using std::cout;
+
+
+double Inverse(int i)
+{
+    if(i == 0)
+        THROWSTREAM << "Error: I can't take the inverse of 0!";
+
+    return 1.0/double(i);
+}
+
+
+int main(int argc, char ** argv)
+{
+    // Jump back to the checkpoint rather than aborting
+    ThrowStreamSetFailureHandler(&ThrowStreamLongjmpHandler);
+
+    for(int i = 2; i >= 0; i--)
+    {
+        ThrowStreamCheckpoint cp;
+        if(THROWSTREAMCHECKPOINT(cp))
+            cout << "\n1/" << i << " = " << Inverse(i) << "\n";
+        else
+            cout << "\n\nError! " << *cp.Error() << "\n\n";
+    }
+
+    // With the default handler, this prints the backtrace and aborts the program
+    if(argc > 1)
+    {
+        cout.flush();
+        ThrowStreamSetFailureHandler(nullptr);
+        cout << "\n1/0 = " << Inverse(0) << "\n";
+    }
+
+    return 0;
+}
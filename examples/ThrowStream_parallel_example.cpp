@@ -0,0 +1,187 @@
+/*
+   An example of using ThrowStream with work run on other threads.
+   Copyright 2013 Benjamin Pritchard
+   Relased under the MIT License
+*/
+
+#include <iostream>
+#include <future>
+#include <thread>
+#include <vector>
+
+// ThrowStream is compiled in this file (unless linking to the throwstream library)
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStream.h"
+#include "ThrowStreamTask.h"
+#include "ThrowStreamCollector.h"
+#include "AggregateThrowStream.h"
+#include "ThrowStreamCancel.h"
+
+using std::cout;
+using std::exception;
+using std::vector;
+
+
+double Inverse(int i)
+{
+    if(i == 0)
+        THROWSTREAM << "Error: I can't take the inverse of 0!";
+
+    return 1.0/double(i);
+}
+
+
+double SumInverses(const vector<int> & values)
+{
+    // Each value is handled by a separate task. If one of them fails, the
+    // exception will show where the task was submitted from
+    vector<std::future<double>> results;
+    for(size_t i = 0; i < values.size(); i++)
+    {
+        int v = values[i];
+        results.push_back(std::async(std::launch::async, THROWSTREAMTASK([v]{ return Inverse(v); })));
+    }
+
+    double sum = 0.0;
+    for(size_t i = 0; i < results.size(); i++)
+        sum += results[i].get();
+    return sum;
+}
+
+
+void CheckAll(const vector<int> & values)
+{
+    // Check the values on several threads, recording every bad value
+    // rather than stopping at the first one
+    ThrowStreamCollector errors;
+    vector<std::thread> threads;
+    const size_t nthreads = 4;
+
+    for(size_t t = 0; t < nthreads; t++)
+    {
+        threads.push_back(std::thread([&values, &errors, t, nthreads]()
+        {
+            for(size_t i = t; i < values.size(); i += nthreads)
+            {
+                if(values[i] <= 0)
+                    THROWSTREAMCOLLECT(errors) << "Value " << i << " is not positive: " << values[i];
+            }
+        }));
+    }
+
+    for(size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    if(!errors.Empty())
+    {
+        THROWSTREAMOBJ(ts) << "Found " << errors.Size() << " bad values";
+        errors.MergeInto(ts);
+        throw ts;
+    }
+}
+
+
+double InvertAll(const vector<int> & values)
+{
+    // Run each value as a separate task, keeping the exceptions from
+    // every task that fails
+    AggregateThrowStreamBuilder errors;
+    vector<std::thread> threads;
+    vector<double> results(values.size());
+
+    for(size_t i = 0; i < values.size(); i++)
+    {
+        threads.push_back(std::thread([&values, &results, &errors, i]()
+        {
+            try
+            {
+                results[i] = Inverse(values[i]);
+            }
+            catch(...)
+            {
+                errors.AddCurrent();
+            }
+        }));
+    }
+
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    if(!errors.Empty())
+        THROWSTREAMAGGREGATE(errors) << errors.Size() << " of " << values.size() << " tasks failed";
+
+    double sum = 0.0;
+    for(size_t i = 0; i < results.size(); i++)
+        sum += results[i];
+    return sum;
+}
+
+
+double InvertAllOrNothing(const vector<int> & values)
+{
+    // Stop all the tasks as soon as one of them fails. Only the
+    // first exception is kept
+    ThrowStreamCancelToken token;
+    vector<std::thread> threads;
+    vector<double> results(values.size());
+
+    for(size_t i = 0; i < values.size(); i++)
+        threads.push_back(std::thread([&values, &results, &token, i]()
+        {
+            token.Run([&]{ results[i] = Inverse(values[i]); });
+        }));
+
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    token.RethrowFirst();
+
+    double sum = 0.0;
+    for(size_t i = 0; i < results.size(); i++)
+        sum += results[i];
+    return sum;
+}
+
+
+int main(int argc, char ** argv)
+{
+    vector<int> values = {1, 2, 0, 4, -3, 6, 0};
+
+    try
+    {
+        cout << "\n\nSum of inverses = " << SumInverses(values) << "\n\n";
+    }
+    catch(const exception & ex)
+    {
+        cout << "\n\nException! what() = " << ex.what() << "\n\n";
+    }
+
+    try
+    {
+        CheckAll(values);
+    }
+    catch(const exception & ex)
+    {
+        cout << "\n\nException! what() = " << ex.what() << "\n\n";
+    }
+
+    try
+    {
+        cout << "\n\nSum of inverses = " << InvertAll(values) << "\n\n";
+    }
+    catch(const exception & ex)
+    {
+        cout << "\n\nException! what() = " << ex.what() << "\n\n";
+    }
+
+    try
+    {
+        cout << "\n\nSum of inverses = " << InvertAllOrNothing(values) << "\n\n";
+    }
+    catch(const exception & ex)
+    {
+        cout << "\n\nException! what() = " << ex.what() << "\n\n";
+    }
+
+    return 0;
+}
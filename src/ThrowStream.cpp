@@ -0,0 +1,12 @@
+/*! \file
+ *  \brief     The compiled part of the throwstream library
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  Code linking to the library must be compiled with THROWSTREAM_COMPILED defined
+ *  (the CMake target does this).
+ */
+
+// ThrowStream.h then includes the implementation, and instantiates ThrowStream
+#define THROWSTREAM_LIBRARY_SOURCE
+#include "ThrowStream.h"
@@ -0,0 +1,133 @@
+/*! \file
+ *  \brief     Checks AggregateThrowStream and appending a ThrowStream to itself
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "AggregateThrowStream.h"
+
+
+static const int NThreads = 8;
+
+
+void Fail(int i)
+{
+    THROWSTREAM << "Task " << i << " failed";
+}
+
+
+//! Does \p text contain \p what exactly \p n times?
+static bool Count(const string & text, const string & what, size_t n)
+{
+    size_t found = 0;
+    for(size_t pos = text.find(what); pos != string::npos; pos = text.find(what, pos + 1))
+        found++;
+    return found == n;
+}
+
+
+int main(void)
+{
+    bool ok = true;
+
+    // Appending to itself copies the frames first
+    ThrowStream ts(ThrowStreamLocation(10, "self.cpp", "Self"));
+    ts << "Original";
+    ts.Append(ts, ThrowStreamLocation(20, "self.cpp", "Caller")) << "Appended";
+    if(ts.Frames().size() != 3 || ts.Frames()[1].message != "Original" || !Count(ts.what(), "Original", 2))
+    {
+        std::cerr << "self append: wrong backtrace:\n" << ts.what() << "\n";
+        ok = false;
+    }
+
+    // Exceptions from many threads, with the same callsite chain
+    AggregateThrowStreamBuilder errors;
+    std::vector<std::thread> threads;
+    for(int t = 0; t < NThreads; t++)
+    {
+        threads.push_back(std::thread([&errors, t]()
+        {
+            try
+            {
+                Fail(t);
+            }
+            catch(...)
+            {
+                errors.AddCurrent();
+            }
+        }));
+    }
+
+    for(size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    try
+    {
+        THROWSTREAMAGGREGATE(errors) << errors.Size() << " tasks failed";
+    }
+    catch(const AggregateThrowStream & agg)
+    {
+        const string text = agg.what();
+        if(agg.Size() != size_t(NThreads) || !Count(text, "8x:", 1) || !Count(text, "Task ", 1))
+        {
+            std::cerr << "aggregate: not grouped:\n" << text << "\n";
+            ok = false;
+        }
+
+        // Each child keeps its original type
+        try
+        {
+            agg.Rethrow(NThreads - 1);
+        }
+        catch(const ThrowStream & child)
+        {
+            if(!Count(child.what(), " failed", 1))
+            {
+                std::cerr << "aggregate: wrong child:\n" << child.what() << "\n";
+                ok = false;
+            }
+        }
+
+        // Out of range
+        try
+        {
+            agg.Rethrow(NThreads);
+            std::cerr << "aggregate: rethrew an exception out of range\n";
+            ok = false;
+        }
+        catch(const ThrowStream & ex)
+        {
+            if(!Count(ex.what(), "only 8 were aggregated", 1))
+            {
+                std::cerr << "aggregate: wrong error when out of range:\n" << ex.what() << "\n";
+                ok = false;
+            }
+        }
+    }
+
+    // A null exception is rejected
+    try
+    {
+        errors.Add(std::exception_ptr());
+        std::cerr << "aggregate: a null exception was added\n";
+        ok = false;
+    }
+    catch(const ThrowStream &)
+    {
+    }
+
+    if(errors.Size() != size_t(NThreads))
+    {
+        std::cerr << "aggregate: " << errors.Size() << " exceptions after adding a null one\n";
+        ok = false;
+    }
+
+    if(ok)
+        std::cout << "aggregate: OK\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+/*! \file
+ *  \brief     Checks that the first error cancels the rest of the work
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStreamCancel.h"
+
+
+static const int NThreads = 8;
+static std::atomic<int> formatted(0); //!< Number of times a Counted was written to a stream
+
+
+//! Counts how many times it is formatted
+struct Counted { };
+
+std::ostream & operator<<(std::ostream & os, const Counted &)
+{
+    formatted++;
+    return os << "counted";
+}
+
+
+int main(void)
+{
+    bool ok = true;
+    ThrowStreamCancelToken token;
+    std::atomic<int> completed(0);
+    std::atomic<int> waiting(0);
+
+    // Every worker but the first waits for the cancellation, then throws.
+    // Those throws must become ThrowStreamCancelled without formatting anything
+    std::vector<std::thread> threads;
+    for(int t = 0; t < NThreads; t++)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            bool ran = token.Run([&]
+            {
+                if(t == 0)
+                {
+                    while(waiting.load() < NThreads - 1)
+                        std::this_thread::yield();
+                    THROWSTREAM << "First error";
+                }
+
+                waiting++;
+                while(!ThrowStreamIsCancelled())
+                    std::this_thread::yield();
+                THROWSTREAM << "Later error " << Counted();
+            });
+
+            if(ran)
+                completed++;
+        }));
+    }
+
+    for(size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    if(completed.load() != 0 || formatted.load() != 0)
+    {
+        std::cerr << "cancel: " << completed.load() << " workers completed, "
+                  << formatted.load() << " later errors were formatted\n";
+        ok = false;
+    }
+
+    // Only the first error is kept
+    try
+    {
+        token.RethrowFirst();
+        std::cerr << "cancel: no error was published\n";
+        ok = false;
+    }
+    catch(const ThrowStream & ts)
+    {
+        if(ts.Frames().size() != 1 || ts.Frames()[0].message != "First error")
+        {
+            std::cerr << "cancel: wrong first error:\n" << ts.what() << "\n";
+            ok = false;
+        }
+    }
+
+    // Work is not started once cancelled
+    if(token.Run([&]{ completed++; }) || completed.load() != 0)
+    {
+        std::cerr << "cancel: work was started after cancelling\n";
+        ok = false;
+    }
+
+    // Outside of the scope, this thread is not affected
+    try
+    {
+        THROWSTREAM << "Not cancelled " << Counted();
+    }
+    catch(const ThrowStream &)
+    {
+    }
+    catch(const ThrowStreamCancelled &)
+    {
+        std::cerr << "cancel: a thread outside of the scope was cancelled\n";
+        ok = false;
+    }
+
+    if(formatted.load() != 1)
+    {
+        std::cerr << "cancel: the error outside of the scope was not formatted\n";
+        ok = false;
+    }
+
+    if(ok)
+        std::cout << "cancel: " << NThreads - 1 << " workers cancelled OK\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+/*! \file
+ *  \brief     Checks ThrowStreamCollector with many threads adding entries at once
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStreamCollector.h"
+
+
+static const int NThreads = 8;
+static const int NEntries = 2000; //!< Entries added by each thread (many segments)
+
+
+//! Get the thread and entry numbers back from a message ("t i")
+static bool Parse(const string & message, int & t, int & i)
+{
+    std::istringstream ss(message);
+    return bool(ss >> t >> i);
+}
+
+
+int main(void)
+{
+    bool ok = true;
+    ThrowStreamCollector errors;
+    std::atomic<int> running(NThreads);
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < NThreads; t++)
+    {
+        threads.push_back(std::thread([&errors, &running, t]()
+        {
+            for(int i = 0; i < NEntries; i++)
+                THROWSTREAMCOLLECT(errors) << t << " " << i;
+            running--;
+        }));
+    }
+
+    // Merge while the entries are still being added. Entries not yet
+    // written are skipped, but everything merged must be complete
+    int merges = 0;
+    while(running.load() > 0 || merges == 0)
+    {
+        ThrowStream partial(THROWSTREAMLOCATION);
+        errors.MergeInto(partial);
+        merges++;
+
+        for(size_t k = 1; k < partial.Frames().size(); k++)
+        {
+            int t, i;
+            if(!Parse(partial.Frames()[k].message, t, i) || t < 0 || t >= NThreads || i < 0 || i >= NEntries)
+            {
+                std::cerr << "concurrent merge: bad entry \"" << partial.Frames()[k].message << "\"\n";
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    for(size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    // Once the threads are joined, every entry is there. Each thread's entries
+    // were started in order, so they must be merged in order
+    ThrowStream ts(THROWSTREAMLOCATION);
+    errors.MergeInto(ts);
+
+    if(errors.Size() != static_cast<unsigned long>(NThreads * NEntries) || ts.Frames().size() != size_t(NThreads * NEntries + 1))
+    {
+        std::cerr << "final merge: " << errors.Size() << " entries started, "
+                  << ts.Frames().size() - 1 << " merged\n";
+        ok = false;
+    }
+
+    std::vector<int> next(NThreads, 0);
+    for(size_t k = 1; ok && k < ts.Frames().size(); k++)
+    {
+        int t, i;
+        if(!Parse(ts.Frames()[k].message, t, i) || t < 0 || t >= NThreads || i != next[t])
+        {
+            std::cerr << "final merge: entry " << k << " (\"" << ts.Frames()[k].message << "\") is out of order\n";
+            ok = false;
+        }
+        else
+            next[t]++;
+    }
+
+    if(ok)
+        std::cout << "collector: " << ts.Frames().size() - 1 << " entries OK (" << merges << " concurrent merges)\n";
+    return ok ? 0 : 1;
+}
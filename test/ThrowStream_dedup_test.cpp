@@ -0,0 +1,68 @@
+/*! \file
+ *  \brief     Checks that ThrowStreamDedupSink writes each failure once, then counts the repeats
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  The window is long, so the only summary is the one written when the sink is
+ *  destroyed, and the output doesn't depend on timing.
+ */
+
+#include <iostream>
+#include <sstream>
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStreamDedupSink.h"
+
+
+static ThrowStream Make(unsigned long line, const char * function)
+{
+    return ThrowStream(ThrowStreamLocation(line, "dedup.cpp", function)) << "Error in " << function;
+}
+
+
+//! Number of times \p what appears in \p text
+static size_t Count(const string & text, const string & what)
+{
+    size_t found = 0;
+    for(size_t pos = text.find(what); pos != string::npos; pos = text.find(what, pos + 1))
+        found++;
+    return found;
+}
+
+
+int main(void)
+{
+    bool ok = true;
+
+    // Room in the table for two fingerprints. The third is always written in full
+    std::ostringstream out;
+    {
+        ThrowStreamDedupSink sink(out, std::chrono::hours(1), 2, 16, ThrowStreamSink::Block);
+        for(int i = 0; i < 100; i++)
+            sink.Submit(Make(10, "Parse"));
+        for(int i = 0; i < 3; i++)
+            sink.Submit(Make(20, "Load"));
+        for(int i = 0; i < 3; i++)
+            sink.Submit(Make(30, "Save"));
+
+        // Not in a catch block
+        if(sink.SubmitCurrent())
+        {
+            std::cerr << "dedup: submitted outside of a catch block\n";
+            ok = false;
+        }
+    }
+
+    const string text = out.str();
+    if(Count(text, "Error in Parse") != 1 || Count(text, "Seen 99 more times in the last 3600s") != 1 ||
+       Count(text, "Error in Load") != 1 || Count(text, "Seen 2 more times in the last 3600s") != 1 ||
+       Count(text, "Error in Save") != 3 || Count(text, "Seen ") != 2)
+    {
+        std::cerr << "dedup: wrong output:\n" << text << "\n";
+        ok = false;
+    }
+
+    if(ok)
+        std::cout << "dedup: OK\n";
+    return ok ? 0 : 1;
+}
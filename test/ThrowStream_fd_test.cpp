@@ -0,0 +1,95 @@
+/*! \file
+ *  \brief     Checks that ThrowStreamWriteFd writes the same as what()
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStreamFd.h"
+
+
+//! Write a ThrowStream to a temporary file, and compare with what()
+static bool Check(const ThrowStream & ts, const char * name)
+{
+    FILE * f = tmpfile();
+    if(f == nullptr)
+    {
+        std::cerr << name << ": cannot create a temporary file\n";
+        return false;
+    }
+
+    bool ok = ThrowStreamWriteFd(fileno(f), ts);
+
+    string written;
+    char buf[4096];
+    rewind(f);
+    for(size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0; )
+        written.append(buf, n);
+    fclose(f);
+
+    const string expected = string(ts.what()) + "\n";
+    if(!ok || written != expected)
+    {
+        size_t i = 0;
+        while(i < written.size() && i < expected.size() && written[i] == expected[i])
+            i++;
+        std::cerr << name << ": output differs from what() at byte " << i << "\n";
+        return false;
+    }
+
+    std::cout << name << ": " << written.size() << " bytes OK\n";
+    return true;
+}
+
+
+int main(void)
+{
+    bool ok = true;
+
+    // A short chain, written in one batch
+    ThrowStream small(ThrowStreamLocation(10, "small.cpp", "Small"));
+    small << "Something failed";
+    small.Append(ThrowStreamLocation(20, "small.cpp", "Caller")) << "While calling Small";
+    ok = Check(small, "short chain") && ok;
+
+    // Long names are passed to writev() directly and the short pieces between them
+    // are copied. With about four segments per entry, this needs several batches
+    std::vector<string> files, functions;
+    for(int i = 0; i < 200; i++)
+    {
+        files.push_back(string(56, 'f') + std::to_string(1000 + i));
+        functions.push_back(string(56, 'g') + std::to_string(1000 + i));
+    }
+
+    ThrowStream chain(ThrowStreamLocation(100, files[0].c_str(), functions[0].c_str()));
+    chain << "Frame " << 0;
+    for(int i = 1; i < 200; i++)
+        chain.Append(ThrowStreamLocation(100 + i, files[i].c_str(), functions[i].c_str())) << "Frame " << i;
+    ok = Check(chain, "long chain") && ok;
+
+    // Many short entries, filling the copy buffer
+    ThrowStream many(ThrowStreamLocation(1, "a.cpp", "A"));
+    many << "x";
+    for(int i = 0; i < 400; i++)
+        many.Append(ThrowStreamLocation(i, "a.cpp", "A")) << i;
+    ok = Check(many, "many short entries") && ok;
+
+    // Messages of error codes are only temporary. Different codes in each entry,
+    // so that a message read after it is freed would be wrong
+    const int codes[] = { ENOTCONN, ECONNREFUSED, EHOSTUNREACH, ENAMETOOLONG };
+    ThrowStream errors(std::error_code(codes[0], std::system_category()), ThrowStreamLocation(1, "e.cpp", "E"));
+    errors << "Cannot connect";
+    for(int i = 1; i < 40; i++)
+    {
+        errors.Append(ThrowStreamLocation(i, "e.cpp", "E")) << "Retry " << i;
+        errors.SetErrorCode(std::error_code(codes[i % 4], std::system_category()));
+    }
+    ok = Check(errors, "error codes") && ok;
+
+        return ok ? 0 : 1;
+}
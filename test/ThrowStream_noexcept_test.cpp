@@ -0,0 +1,109 @@
+/*! \file
+ *  \brief     Checks raising ThrowStreams in code built without exceptions
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  Built with -fno-exceptions (see CMakeLists.txt).
+ */
+
+#include <iostream>
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStream.h"
+#include "ThrowStreamPolicies.h"
+
+#ifdef THROWSTREAM_EXCEPTIONS
+#error "This test must be built without exceptions"
+#endif
+
+
+typedef ThrowStreamBasic<ThrowStreamFixedStorage<64>, ThrowStreamStreamFormat, ThrowStreamCompactRender> FastError;
+
+
+void Fail(int i)
+{
+    THROWSTREAM << "Value " << i << " is bad";
+}
+
+
+void FailFast(int i)
+{
+    ThrowStreamRaise(FastError(ThrowStreamLocation(7, "fast.cpp", "FailFast")) << "Queue full: " << i);
+}
+
+
+int main(void)
+{
+    bool ok = true;
+    ThrowStreamSetFailureHandler(&ThrowStreamLongjmpHandler);
+
+    // The macros
+    {
+        ThrowStreamCheckpoint cp;
+        if(THROWSTREAMCHECKPOINT(cp))
+        {
+            Fail(3);
+            std::cerr << "macro: returned from the failure handler\n";
+            ok = false;
+        }
+        else if(cp.Error() == nullptr || cp.Error()->Frames().size() != 1 ||
+                cp.Error()->Frames()[0].message != "Value 3 is bad")
+        {
+            std::cerr << "macro: wrong error\n";
+            ok = false;
+        }
+    }
+
+    // A ThrowStreamBasic with other policies is passed on as a ThrowStream
+    {
+        ThrowStreamCheckpoint cp;
+        if(THROWSTREAMCHECKPOINT(cp))
+        {
+            FailFast(5);
+            std::cerr << "other policies: returned from the failure handler\n";
+            ok = false;
+        }
+        else if(cp.Error() == nullptr || cp.Error()->Frames().size() != 1 ||
+                cp.Error()->Frames()[0].message != "Queue full: 5" ||
+                cp.Error()->Frames()[0].line != 7)
+        {
+            std::cerr << "other policies: wrong error\n";
+            ok = false;
+        }
+    }
+
+    // The copy made for the handler was moved to the checkpoint
+    if(ThrowStreamRaised())
+    {
+        std::cerr << "other policies: the copy was not moved to the checkpoint\n";
+        ok = false;
+    }
+
+    // Aggregated exceptions survive Deserialize, held by ThrowStreamChild::held
+    {
+        std::shared_ptr<ThrowStream> task(new ThrowStream(ThrowStreamLocation(3, "task.cpp", "Task")));
+        *task << "Task failed";
+
+        std::shared_ptr<std::vector<ThrowStreamChild>> children(new std::vector<ThrowStreamChild>(1));
+        (*children)[0].held = task;
+        (*children)[0].ex = task.get();
+        (*children)[0].ts = task.get();
+
+        ThrowStream agg(ThrowStreamLocation(9, "main.cpp", "Run"));
+        agg.SetChildren(children) << "1 task failed";
+
+        char buf[512];
+        size_t n = agg.Serialize(buf, sizeof(buf));
+        const ThrowStream copy = ThrowStream::Deserialize(buf, n);
+        const ThrowStream::Frame & f = copy.Frames()[0];
+        if(n > sizeof(buf) || !f.children || f.children->size() != 1 || string(copy.what()) != agg.what())
+        {
+            std::cerr << "deserialize: aggregated exceptions were not kept:\n" << copy.what() << "\n";
+            ok = false;
+        }
+    }
+
+    if(ok)
+        std::cout << "noexcept: OK\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+/*! \file
+ *  \brief     Checks that the other policies give the same messages as ThrowStream
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#include <iostream>
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStream.h"
+#include "ThrowStreamPolicies.h"
+
+
+typedef ThrowStreamBasic<ThrowStreamStringStorage, ThrowStreamDeferredFormat, ThrowStreamTextRender> DeferredError;
+typedef ThrowStreamBasic<ThrowStreamFixedStorage<256>, ThrowStreamDeferredFormat, ThrowStreamTextRender> FixedError;
+
+enum Color { Red, Green };
+
+struct Point
+{
+    int x, y;
+};
+
+std::ostream & operator<<(std::ostream & os, const Point & p)
+{
+    return os << "(" << p.x << ", " << p.y << ")";
+}
+
+
+//! Add the same values to any kind of exception
+template<typename E>
+E Make()
+{
+    const int values[] = { 1, 2 };
+    const string str = "a string";
+    short s = -12;
+    signed char sc = 'x';
+
+    E ex(ThrowStreamLocation(10, "policies.cpp", "Make"));
+    ex << "Values: " << 42 << " " << -7 << " " << 123456789012LL << " " << 3.25 << " "
+       << 1e-300 << " " << true << " " << 'c' << " " << sc << " " << s << " "
+       << Green << " " << str << " " << Point{ 3, 4 } << " " << 18446744073709551615ULL;
+    ex.Append(ThrowStreamLocation(20, "policies.cpp", "Caller")) << (const void *)values << " " << 0.1f;
+    return ex;
+}
+
+
+static bool Check(const char * name, const char * what, const string & expected)
+{
+    if(expected != what)
+    {
+        std::cerr << name << ": output differs\nExpected:" << expected << "\nGot:" << what << "\n";
+        return false;
+    }
+    std::cout << name << ": OK\n";
+    return true;
+}
+
+
+int main(void)
+{
+    bool ok = true;
+    const ThrowStream plain = Make<ThrowStream>();
+    const string expected = plain.what();
+
+    const DeferredError deferred = Make<DeferredError>();
+    ok = Check("deferred format", deferred.what(), expected) && ok;
+
+    // Only the floating-point numbers, bool, enum, and pointer are left until rendering
+    if(deferred.Frames()[0].deferred.size() != 4 || deferred.Frames()[1].deferred.size() != 2)
+    {
+        std::cerr << "deferred format: " << deferred.Frames()[0].deferred.size() << " and "
+                  << deferred.Frames()[1].deferred.size() << " values deferred\n";
+        ok = false;
+    }
+
+    // The deferred values are shared by copies
+    const DeferredError copy(deferred);
+    ok = Check("deferred format, copied", copy.what(), expected) && ok;
+
+    const FixedError fixed = Make<FixedError>();
+    ok = Check("deferred format, fixed storage", fixed.what(), expected) && ok;
+
+    return ok ? 0 : 1;
+}
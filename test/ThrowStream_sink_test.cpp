@@ -0,0 +1,137 @@
+/*! \file
+ *  \brief     Checks that ThrowStreamSink writes, drops, and blocks as expected
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStreamSink.h"
+
+
+static const int NThreads = 4;
+static const int NEach = 2000; //!< Exceptions submitted by each thread
+
+
+//! A stream buffer that holds up the background thread in flush() until opened
+struct Gate : public std::stringbuf
+{
+    std::mutex m;
+    std::condition_variable cv;
+    bool open = false;
+    bool waiting = false;
+
+    int sync()
+    {
+        std::unique_lock<std::mutex> lock(m);
+        waiting = true;
+        cv.notify_all();
+        cv.wait(lock, [this]() { return open; });
+        return 0;
+    }
+
+    void WaitForWriter()
+    {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [this]() { return waiting; });
+    }
+
+    void Open()
+    {
+        std::lock_guard<std::mutex> lock(m);
+        open = true;
+        cv.notify_all();
+    }
+};
+
+
+static std::exception_ptr Make(int i)
+{
+    return std::make_exception_ptr(ThrowStream(ThrowStreamLocation(i, "sink.cpp", "Make")) << "Error " << i);
+}
+
+
+//! Number of times \p what appears in \p text
+static size_t Count(const string & text, const string & what)
+{
+    size_t found = 0;
+    for(size_t pos = text.find(what); pos != string::npos; pos = text.find(what, pos + 1))
+        found++;
+    return found;
+}
+
+
+int main(void)
+{
+    bool ok = true;
+
+    // With a tiny queue, blocked threads must all get through
+    std::ostringstream blocked;
+    {
+        ThrowStreamSink sink(blocked, 2, ThrowStreamSink::Block);
+        std::vector<std::thread> threads;
+        for(int t = 0; t < NThreads; t++)
+        {
+            threads.push_back(std::thread([&sink, t]()
+            {
+                for(int i = 0; i < NEach; i++)
+                    sink.Submit(Make(t * NEach + i));
+            }));
+        }
+
+        for(size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+
+        if(sink.Dropped() != 0)
+        {
+            std::cerr << "block: " << sink.Dropped() << " exceptions dropped\n";
+            ok = false;
+        }
+    }
+
+    if(Count(blocked.str(), "Error ") != size_t(NThreads * NEach))
+    {
+        std::cerr << "block: " << Count(blocked.str(), "Error ") << " exceptions written\n";
+        ok = false;
+    }
+
+    // Once the queue is full, the next one is dropped. Null exceptions are
+    // rejected without being counted
+    Gate gate;
+    std::ostream os(&gate);
+    {
+        ThrowStreamSink sink(os, 2, ThrowStreamSink::Drop);
+        sink.Submit(Make(1));
+        gate.WaitForWriter(); // the first is being written, and the queue is empty
+
+        bool accepted = sink.Submit(Make(2)) && sink.Submit(Make(3));
+        bool dropped = !sink.Submit(Make(4));
+        bool rejected = !sink.Submit(std::exception_ptr()) && !sink.SubmitCurrent();
+
+        if(!accepted || !dropped || !rejected || sink.Dropped() != 1)
+        {
+            std::cerr << "drop: accepted " << accepted << ", dropped " << dropped
+                      << ", rejected null " << rejected << ", count " << sink.Dropped() << "\n";
+            ok = false;
+        }
+
+        gate.Open();
+    }
+
+    const string written = gate.str();
+    if(Count(written, "Error ") != 3 || Count(written, "Error 4") != 0)
+    {
+        std::cerr << "drop: wrong output:\n" << written << "\n";
+        ok = false;
+    }
+
+    if(ok)
+        std::cout << "sink: OK\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+/*! \file
+ *  \brief     Streams literals of several lengths and the common scalar types
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  Only compiled, not run. symbols_test.cmake checks that literals don't each
+ *  instantiate the stream operator, and that without THROWSTREAM_IMPLEMENTATION
+ *  the code for these types is left to the implementation file.
+ */
+
+#include <string>
+#include "ThrowStream.h"
+
+
+void Literals(ThrowStream & ts)
+{
+    ts << "a" << "ab" << "abc" << "abcd" << "abcde" << "abcdef" << "abcdefg"
+       << "a somewhat longer literal" << "and one that is longer than all of the others";
+}
+
+
+void Scalars(ThrowStream & ts, const std::string & s)
+{
+    ts << 'c' << true << int(-1) << 1u << -1L << 1UL << -1LL << 1ULL << 1.5 << s;
+}
@@ -0,0 +1,170 @@
+/*! \file
+ *  \brief     Checks that Serialize and Deserialize round-trip, and reject bad data
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ */
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "AggregateThrowStream.h"
+
+
+void Fail(int i)
+{
+    THROWSTREAMEC(std::make_error_code(std::errc::connection_refused)) << "Task " << i << " failed";
+}
+
+
+//! An exception with an error code, and an entry that isn't a ThrowStream
+static ThrowStream Make()
+{
+    ThrowStream ts(ThrowStreamLocation(30, "wire.cpp", "Open"));
+    ts << "Can't open " << "input.dat";
+    ts.SetErrorCode(std::make_error_code(std::errc::no_such_file_or_directory));
+    ts.Append(std::runtime_error("Not a ThrowStream"), ThrowStreamLocation(31, "wire.cpp", "Load")) << "Loading";
+    ts.Append(ThrowStreamLocation(40, "wire.cpp", "Caller")) << "Value " << 2.5;
+    return ts;
+}
+
+
+//! Serialize, checking the size asked for
+static std::vector<char> Write(const ThrowStream & ts)
+{
+    std::vector<char> buf(ts.Serialize(nullptr, 0));
+    if(ts.Serialize(buf.data(), buf.size()) != buf.size())
+        buf.clear();
+    return buf;
+}
+
+
+//! Deserialize, returning the error message (empty if it succeeded)
+static string Read(const std::vector<char> & buf, size_t size)
+{
+    try
+    {
+        ThrowStream::Deserialize(buf.data(), size);
+        return string();
+    }
+    catch(const ThrowStream & ex)
+    {
+        return ex.Frames().back().message;
+    }
+}
+
+
+int main(void)
+{
+    bool ok = true;
+
+    // An aggregate, with its children
+    AggregateThrowStreamBuilder errors;
+    try
+    {
+        Fail(7);
+    }
+    catch(...)
+    {
+        errors.AddCurrent();
+    }
+    errors.Add(std::make_exception_ptr(std::runtime_error("Not a ThrowStream")));
+
+    std::vector<ThrowStream> originals;
+    originals.push_back(Make());
+    try
+    {
+        THROWSTREAMAGGREGATE(errors) << "Aggregated";
+    }
+    catch(const AggregateThrowStream & agg)
+    {
+        originals.push_back(agg);
+    }
+
+    for(size_t i = 0; i < originals.size(); i++)
+    {
+        const ThrowStream & original = originals[i];
+        const std::vector<char> buf = Write(original);
+        const ThrowStream copy = ThrowStream::Deserialize(buf.data(), buf.size());
+
+        if(buf.empty() || string(copy.what()) != original.what() ||
+           copy.Fingerprint() != original.Fingerprint())
+        {
+            std::cerr << "round trip " << i << ": differs\nExpected:" << original.what()
+                      << "\nGot:" << copy.what() << "\n";
+            ok = false;
+        }
+    }
+
+    const ThrowStream & agg = originals[1];
+    const std::vector<char> buf = Write(agg);
+    const ThrowStream copy = ThrowStream::Deserialize(buf.data(), buf.size());
+    if(!copy.Frames()[0].children || copy.Frames()[0].children->size() != 2 ||
+       copy.Frames()[0].children->at(0).ts->ErrorCode() != std::make_error_code(std::errc::connection_refused))
+    {
+        std::cerr << "round trip: aggregated exceptions were not kept\n";
+        ok = false;
+    }
+
+    // Every truncation is rejected
+    for(size_t size = 0; size < buf.size(); size++)
+    {
+        if(Read(buf, size).find("Malformed ThrowStream data") == string::npos)
+        {
+            std::cerr << "truncated to " << size << " bytes: not rejected\n";
+            ok = false;
+            break;
+        }
+    }
+
+    // Corrupt data
+    struct Corruption
+    {
+        size_t pos;           //!< Byte to change
+        unsigned char value;  //!< What to change it to
+        const char * problem; //!< The error expected
+    };
+
+    const Corruption corruptions[] = {
+        { 0, 'X', "not ThrowStream data" },
+        { 3, 99, "unsupported version" },
+        { 4, 0, "no entries" },
+        { 5, 0x70, "unknown flags" },
+    };
+
+    for(size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]); i++)
+    {
+        std::vector<char> bad(buf);
+        bad[corruptions[i].pos] = char(corruptions[i].value);
+        const string error = Read(bad, bad.size());
+        if(error.find(corruptions[i].problem) == string::npos)
+        {
+            std::cerr << "corrupt byte " << corruptions[i].pos << ": got \"" << error
+                      << "\", expected \"" << corruptions[i].problem << "\"\n";
+            ok = false;
+        }
+    }
+
+    // Trailing data
+    std::vector<char> longer(buf);
+    longer.push_back(0);
+    if(Read(longer, longer.size()).find("trailing data") == string::npos)
+    {
+        std::cerr << "trailing data: not rejected\n";
+        ok = false;
+    }
+
+    // A number that never ends, in place of the count of entries
+    std::vector<char> endless(buf.begin(), buf.begin() + 4);
+    endless.resize(20, char(0xff));
+    if(Read(endless, endless.size()).find("Malformed ThrowStream data") == string::npos)
+    {
+        std::cerr << "endless number: not rejected\n";
+        ok = false;
+    }
+
+    if(ok)
+        std::cout << "wire: OK\n";
+    return ok ? 0 : 1;
+}
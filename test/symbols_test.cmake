@@ -0,0 +1,75 @@
+# Checks the objects built from ThrowStream_symbols_test.cpp (run with cmake -P)
+#
+#   -DNM=<nm> -DSIZE=<size> -DHEADER=<object or archive built with THROWSTREAM_IMPLEMENTATION>
+#   -DCOMPILED=<the same, built without it>
+#
+# With the implementation, each operand type should define at most one stream operator,
+# with no instantiations for string literals of different lengths. Without it, they
+# should all be left to the implementation file, leaving much less code.
+
+# The stream operators of ThrowStreamBasic defined in a file, one per line
+function(defined_operators file result)
+  execute_process(COMMAND ${NM} -C ${file} OUTPUT_VARIABLE out RESULT_VARIABLE rc)
+  if (NOT rc EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${file}")
+  endif ()
+  string(REPLACE "\n" ";" lines "${out}")
+  set(found "")
+  foreach (line IN LISTS lines)
+    if (line MATCHES " [TW] ThrowStreamBasic<.*>::operator<<")
+      list(APPEND found "${line}")
+    endif ()
+  endforeach ()
+  set(${result} "${found}" PARENT_SCOPE)
+endfunction()
+
+# Total size of the .text sections in a file
+function(text_size file result)
+  execute_process(COMMAND ${SIZE} -A ${file} OUTPUT_VARIABLE out RESULT_VARIABLE rc)
+  if (NOT rc EQUAL 0)
+    message(FATAL_ERROR "${SIZE} failed on ${file}")
+  endif ()
+  string(REPLACE "\n" ";" lines "${out}")
+  set(total 0)
+  foreach (line IN LISTS lines)
+    if (line MATCHES "^\\.text[^ ]* +([0-9]+)")
+      math(EXPR total "${total} + ${CMAKE_MATCH_1}")
+    endif ()
+  endforeach ()
+  set(${result} ${total} PARENT_SCOPE)
+endfunction()
+
+# The test file streams these operand types, and literals of nine lengths. The
+# implementation also defines the operator for deferred parts of messages
+set(OPERAND_TYPES 12)
+
+defined_operators(${HEADER} header_ops)
+defined_operators(${COMPILED} compiled_ops)
+list(LENGTH header_ops header_count)
+list(LENGTH compiled_ops compiled_count)
+text_size(${HEADER} header_text)
+text_size(${COMPILED} compiled_text)
+
+message(STATUS "implementation: ${header_count} stream operators, .text ${header_text} bytes")
+message(STATUS "other files:    ${compiled_count} stream operators, .text ${compiled_text} bytes")
+
+foreach (line IN LISTS header_ops)
+  if (line MATCHES "operator<< <")
+    message(FATAL_ERROR "The stream operator template was instantiated:\n${line}")
+  endif ()
+endforeach ()
+
+if (header_count GREATER OPERAND_TYPES)
+  string(REPLACE ";" "\n" header_ops "${header_ops}")
+  message(FATAL_ERROR "More than one stream operator per operand type:\n${header_ops}")
+endif ()
+
+if (NOT compiled_count EQUAL 0)
+  string(REPLACE ";" "\n" compiled_ops "${compiled_ops}")
+  message(FATAL_ERROR "Stream operators defined outside of the implementation:\n${compiled_ops}")
+endif ()
+
+math(EXPR limit "${header_text} / 4")
+if (NOT compiled_text LESS limit)
+  message(FATAL_ERROR "Without the implementation, .text is ${compiled_text} bytes (expected under ${limit})")
+endif ()
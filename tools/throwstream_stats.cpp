@@ -0,0 +1,669 @@
+/*! \file
+ *  \brief     throwstream-stats: summarize the ThrowStream backtraces in log files
+ *  \author    Benjamin Pritchard (ben@bennyp.org)
+ *  \copyright 2013 Benjamin Pritchard. Released under the MIT License
+ *
+ *  \code{.unparsed}
+ *    throwstream-stats [-n count] [-j threads] [--chunk bytes] [--no-lines] file...
+ *  \endcode
+ *
+ *  Reads logs containing what() output in the default layout
+ *  ("( file:line , in func() )    ->  message") and reports the most common
+ *  callsites, the most common chains of callsites, and the number of exceptions
+ *  in each minute.
+ *
+ *  Each file is mapped into memory and split into chunks, which are scanned in
+ *  parallel. An exception is a run of consecutive entry lines, along with the
+ *  "3x:" style labels of aggregated exceptions. Its time is taken from the most
+ *  recent line starting with a timestamp ("2026-10-17 10:01:..." or
+ *  "2026-10-17T10:01:...", optionally after a '['). Summary lines written by
+ *  ThrowStreamDedupSink add their counts to their callsite, which has no line
+ *  number (use --no-lines to combine them with the entries they summarize).
+ *
+ *  Messages that span several lines end the exception at their first line break,
+ *  so any entries after that are counted as a separate chain.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define THROWSTREAM_IMPLEMENTATION
+#include "ThrowStream.h"
+
+using std::cout;
+using std::vector;
+
+
+//! Size of the pieces each file is split into, unless given with --chunk
+static const size_t ChunkSize = 16 * 1024 * 1024;
+
+//! How far back to look for the timestamp in force at the start of a chunk
+static const size_t StampSearch = 1024 * 1024;
+
+//! Between the location and the message of each entry
+static const char Arrow[] = " )    ->  ";
+static const size_t ArrowLength = sizeof(Arrow) - 1;
+
+
+//! A callsite, and how many times it was seen
+struct Site
+{
+    unsigned long count;
+    string text;         //!< "file:line , in func()"
+};
+
+
+//! A chain of callsites (oldest first), and how many times it was seen
+struct Chain
+{
+    unsigned long count;
+    vector<string> sites;
+};
+
+
+//! What was found in part of the logs
+struct Stats
+{
+    unsigned long exceptions = 0;                       //!< Number of exceptions
+    std::unordered_map<uint64_t, Site> sites;           //!< By hash of the callsite
+    std::unordered_map<uint64_t, Chain> chains;         //!< By hash of the chain
+    std::map<string, unsigned long> minutes;            //!< Exceptions in each minute ("YYYY-MM-DD HH:MM")
+
+    //! Add everything from another Stats
+    void Merge(const Stats & other)
+    {
+        exceptions += other.exceptions;
+        for(const auto & s : other.sites)
+        {
+            auto r = sites.insert(s);
+            if(!r.second)
+                r.first->second.count += s.second.count;
+        }
+        for(const auto & c : other.chains)
+        {
+            auto r = chains.insert(c);
+            if(!r.second)
+                r.first->second.count += c.second.count;
+        }
+        for(const auto & m : other.minutes)
+            minutes[m.first] += m.second;
+    }
+};
+
+
+//! Find the next occurrence of a byte, or \p end (SSE2 where available, otherwise memchr)
+static const char * FindByte(const char * p, const char * end, char c)
+{
+#ifdef __SSE2__
+    const __m128i needle = _mm_set1_epi8(c);
+    while(end - p >= 64)
+    {
+        const __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), needle);
+        const __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16)), needle);
+        const __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32)), needle);
+        const __m128i e = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48)), needle);
+        if(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(d, e))) != 0)
+        {
+            const uint64_t mask = uint64_t(unsigned(_mm_movemask_epi8(a)))
+                                | uint64_t(unsigned(_mm_movemask_epi8(b))) << 16
+                                | uint64_t(unsigned(_mm_movemask_epi8(d))) << 32
+                                | uint64_t(unsigned(_mm_movemask_epi8(e))) << 48;
+            return p + __builtin_ctzll(mask);
+        }
+        p += 64;
+    }
+    while(end - p >= 16)
+    {
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), needle));
+        if(mask != 0)
+            return p + __builtin_ctz(unsigned(mask));
+        p += 16;
+    }
+#endif
+    const void * r = memchr(p, c, size_t(end - p));
+    return (r != nullptr) ? static_cast<const char *>(r) : end;
+}
+
+
+//! Find the arrow between the location and the message of an entry, or null
+static const char * FindArrow(const char * p, const char * end)
+{
+    for(p += 7; p < end; p++)
+    {
+        p = FindByte(p, end, '>');
+        if(p == end)
+            break;
+        if(end - (p - 7) >= ptrdiff_t(ArrowLength) && memcmp(p - 7, Arrow, ArrowLength) == 0)
+            return p - 7;
+    }
+    return nullptr;
+}
+
+
+//! Find a string within [p, end), or null
+static const char * FindText(const char * p, const char * end, const char * text, size_t size)
+{
+    for(; end - p >= ptrdiff_t(size); p++)
+    {
+        p = FindByte(p, end - size + 1, text[0]);
+        if(end - p < ptrdiff_t(size))
+            break;
+        if(memcmp(p, text, size) == 0)
+            return p;
+    }
+    return nullptr;
+}
+
+
+//! Read a timestamp from the start of a line, to the minute ("YYYY-MM-DD HH:MM")
+static bool ReadMinute(const char * p, const char * end, char * minute)
+{
+    static const char pattern[] = "dddd-dd-dd?dd:dd";
+
+    if(p < end && *p == '[')
+        p++;
+    if(end - p < 16)
+        return false;
+
+    for(int i = 0; i < 16; i++)
+    {
+        const char c = p[i];
+        const char f = pattern[i];
+        if(f == 'd' ? (c < '0' || c > '9') : (f == '?' ? (c != ' ' && c != 'T') : c != f))
+            return false;
+    }
+
+    memcpy(minute, p, 16);
+    minute[10] = ' ';
+    return true;
+}
+
+
+//! Remove ":line" and ":line:column" from the end of a location
+static const char * StripLine(const char * file, const char * end)
+{
+    for(int i = 0; i < 2; i++)
+    {
+        const char * p = end;
+        while(p > file && p[-1] >= '0' && p[-1] <= '9')
+            p--;
+        if(p == end || p == file || p[-1] != ':')
+            break;
+        end = p - 1;
+    }
+    return end;
+}
+
+
+//! Scans one chunk of a file
+class ChunkScanner
+{
+private:
+    //! What a line is
+    enum Kind
+    {
+        Other,   //!< Not part of an exception
+        Entry,   //!< An entry of a backtrace
+        Label,   //!< Heads a group of aggregated exceptions ("3x:")
+        Repeats  //!< A ThrowStreamDedupSink summary
+    };
+
+    //! An entry line, split up
+    struct Line
+    {
+        Kind kind;
+        size_t indent;
+        const char * loc;      //!< "file:line , in func()"
+        const char * locEnd;
+        const char * fileEnd;  //!< End of the file name, without the line (if ignoring lines)
+        const char * func;     //!< Start of the function name
+        unsigned long weight;  //!< Count for a label or a summary
+    };
+
+    //! A chain being read, at one level of indentation
+    struct Run
+    {
+        size_t indent;
+        unsigned long weight;
+        uint64_t hash;
+        vector<uint64_t> sites;
+    };
+
+    Stats & _stats;
+    const bool _lines;          //!< Are line numbers part of a callsite?
+    vector<Run> _runs;          //!< Chains being read, least indented first
+    size_t _open = 0;           //!< Number of entries of \p _runs in use
+    char _minute[16];           //!< Time of the most recent timestamp
+    bool _haveMinute = false;
+    unsigned long * _minuteCount = nullptr; //!< Entry in _stats.minutes for _minute
+
+
+    //! Split a line up
+    Line Classify(const char * p, const char * end) const
+    {
+        Line l = { Other, 0, nullptr, nullptr, nullptr, nullptr, 1 };
+
+        while(p + l.indent < end && p[l.indent] == ' ')
+            l.indent++;
+        const char * s = p + l.indent;
+
+        if(end - s >= 2 && s[0] == '(' && s[1] == ' ')
+        {
+            const char * arrow = FindArrow(s, end);
+            const char * in = (arrow != nullptr) ? FindText(s + 2, arrow, " , in ", 6) : nullptr;
+            if(in == nullptr)
+                return l;
+
+            l.kind = Entry;
+            l.loc = s + 2;
+            l.locEnd = arrow;
+            l.func = in + 6;
+            const char * stripped = StripLine(l.loc, in);
+            l.fileEnd = _lines ? in : stripped;
+
+            // A location without a line, with a count as the message, is a summary
+            static const char seen[] = "Seen ";
+            const char * msg = arrow + ArrowLength;
+            if(stripped == in && end - msg > 5 && memcmp(msg, seen, 5) == 0)
+            {
+                char * num_end = nullptr;
+                l.weight = strtoul(msg + 5, &num_end, 10);
+                if(num_end != msg + 5)
+                    l.kind = Repeats;
+            }
+            return l;
+        }
+
+        if(l.indent > 0 && end > s && end[-1] == ':')
+        {
+            // "3x:" gives the count; other labels ("rank 3, 7:") count once
+            l.kind = Label;
+            const char * d = s;
+            unsigned long n = 0;
+            while(d < end && *d >= '0' && *d <= '9')
+                n = n * 10 + unsigned(*d++ - '0');
+            if(d > s && d + 2 == end && *d == 'x')
+                l.weight = n;
+        }
+        return l;
+    }
+
+
+    //! Add to the number of exceptions, in total and in the current minute
+    void CountExceptions(unsigned long n)
+    {
+        _stats.exceptions += n;
+        if(_haveMinute)
+        {
+            if(_minuteCount == nullptr)
+                _minuteCount = &_stats.minutes[string(_minute, 16)];
+            *_minuteCount += n;
+        }
+    }
+
+
+    //! Add to the count of a callsite
+    uint64_t CountSite(const Line & l, unsigned long n)
+    {
+        uint64_t h = ThrowStreamFingerprintAdd(14695981039346656037ULL, l.loc, size_t(l.fileEnd - l.loc));
+        h = ThrowStreamFingerprintAdd(h, l.func - 6, size_t(l.locEnd - l.func) + 6);
+
+        auto it = _stats.sites.find(h);
+        if(it == _stats.sites.end())
+        {
+            Site site = { 0, string(l.loc, l.fileEnd) };
+            site.text.append(l.func - 6, l.locEnd);
+            it = _stats.sites.insert(std::make_pair(h, std::move(site))).first;
+        }
+        it->second.count += n;
+        return h;
+    }
+
+
+    //! Start a chain. The runs are reused, so this doesn't allocate
+    Run & OpenRun(size_t indent, unsigned long weight)
+    {
+        if(_open == _runs.size())
+            _runs.push_back(Run());
+
+        Run & run = _runs[_open++];
+        run.indent = indent;
+        run.weight = weight;
+        run.hash = 14695981039346656037ULL;
+        run.sites.clear();
+        return run;
+    }
+
+
+    //! Finish the chains indented by at least \p indent
+    void CloseRuns(size_t indent)
+    {
+        while(_open > 0 && _runs[_open - 1].indent >= indent)
+        {
+            const Run & run = _runs[--_open];
+            if(run.sites.empty()) // a label with nothing after it
+                continue;
+
+            auto it = _stats.chains.find(run.hash);
+            if(it == _stats.chains.end())
+            {
+                Chain chain = { 0, vector<string>() };
+                for(size_t i = 0; i < run.sites.size(); i++)
+                    chain.sites.push_back(_stats.sites[run.sites[i]].text);
+                it = _stats.chains.insert(std::make_pair(run.hash, std::move(chain))).first;
+            }
+            it->second.count += run.weight;
+        }
+    }
+
+
+    //! Handle one line
+    void Process(const char * p, const char * end)
+    {
+        const Line l = Classify(p, end);
+
+        if(l.kind == Other)
+        {
+            CloseRuns(0);
+            char minute[16];
+            if(ReadMinute(p, end, minute) && (!_haveMinute || memcmp(minute, _minute, 16) != 0))
+            {
+                memcpy(_minute, minute, 16);
+                _haveMinute = true;
+                _minuteCount = nullptr;
+            }
+        }
+        else if(l.kind == Repeats)
+        {
+            CloseRuns(0);
+            CountSite(l, l.weight);
+            CountExceptions(l.weight);
+        }
+        else if(l.kind == Label)
+        {
+            CloseRuns(l.indent);
+            OpenRun(l.indent, l.weight);
+        }
+        else
+        {
+            CloseRuns(l.indent + 1);
+            if(_open == 0)
+                CountExceptions(1);
+            Run & run = (_open > 0 && _runs[_open - 1].indent == l.indent) ? _runs[_open - 1]
+                                                                            : OpenRun(l.indent, 1);
+
+            const uint64_t site = CountSite(l, run.weight);
+            run.hash = ThrowStreamFingerprintAdd(run.hash, &site, sizeof(site));
+            run.sites.push_back(site);
+        }
+    }
+
+
+    //! Find the timestamp in force at \p p, by looking back through the lines before it
+    void FindMinute(const char * base, const char * p)
+    {
+        _haveMinute = false;
+        _minuteCount = nullptr;
+
+        const char * limit = (size_t(p - base) > StampSearch) ? p - StampSearch : base;
+        const char * end = p;
+        while(end > limit)
+        {
+            const char * start = end - 1; // the newline ending the previous line
+            while(start > limit && start[-1] != '\n')
+                start--;
+            if(ReadMinute(start, end - 1, _minute))
+            {
+                _haveMinute = true;
+                return;
+            }
+            end = start;
+        }
+    }
+
+
+public:
+    ChunkScanner(Stats & stats, bool lines)
+        : _stats(stats), _lines(lines)
+    { }
+
+
+    //! Scan the lines starting in [begin, end) of a file
+    /*!
+     *  An exception that starts in the chunk is read to its end, even past
+     *  \p end. Lines at the start that continue one from the previous chunk are skipped.
+     */
+    void Scan(const char * base, size_t size, size_t begin, size_t end)
+    {
+        const char * fileEnd = base + size;
+        const char * p = base + begin;
+
+        if(begin > 0 && p[-1] != '\n')
+            p = std::min(FindByte(p, fileEnd, '\n') + 1, fileEnd);
+
+        if(begin > 0)
+        {
+            FindMinute(base, p);
+            while(p < fileEnd)
+            {
+                const char * nl = FindByte(p, fileEnd, '\n');
+                const char * e = (nl > p && nl[-1] == '\r') ? nl - 1 : nl;
+                if(Classify(p, e).kind == Other)
+                    break;
+                p = std::min(nl + 1, fileEnd);
+            }
+        }
+
+        while(p < fileEnd)
+        {
+            const char * nl = FindByte(p, fileEnd, '\n');
+            const char * e = (nl > p && nl[-1] == '\r') ? nl - 1 : nl;
+            if(p >= base + end && Classify(p, e).kind == Other)
+                break;
+            Process(p, e);
+            p = std::min(nl + 1, fileEnd);
+        }
+        CloseRuns(0);
+    }
+};
+
+
+//! Scan a file with several threads, in chunks of \p chunk bytes, adding to one Stats for each thread
+static void ScanFile(const char * path, size_t chunk, bool lines, vector<Stats> & stats)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        THROWSTREAMERRNO << "Opening " << path;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        THROWSTREAMERRNO << "Reading the size of " << path;
+    }
+
+    const size_t size = size_t(st.st_size);
+    if(size == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    void * map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        THROWSTREAMERRNO << "Mapping " << path;
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const char * base = static_cast<const char *>(map);
+    const size_t nchunks = (size + chunk - 1) / chunk;
+    std::atomic<size_t> next(0);
+
+    vector<std::thread> threads;
+    for(size_t t = 0; t < stats.size() && t < nchunks; t++)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            ChunkScanner scanner(stats[t], lines);
+            for(size_t c = next++; c < nchunks; c = next++)
+                scanner.Scan(base, size, c * chunk, std::min(size, (c + 1) * chunk));
+        }));
+    }
+    for(size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    munmap(map, size);
+}
+
+
+//! Order for listing callsites and chains with the same count
+static const string & SortKey(const Site & s)
+{
+    return s.text;
+}
+
+static const vector<string> & SortKey(const Chain & c)
+{
+    return c.sites;
+}
+
+
+//! Sort by count, most common first
+template<typename T>
+static vector<const T *> Top(const std::unordered_map<uint64_t, T> & m, size_t n)
+{
+    vector<const T *> v;
+    for(const auto & e : m)
+        v.push_back(&e.second);
+
+    n = std::min(n, v.size());
+    std::partial_sort(v.begin(), v.begin() + n, v.end(), [](const T * a, const T * b)
+    {
+        return (a->count != b->count) ? a->count > b->count : SortKey(*a) < SortKey(*b);
+    });
+    v.resize(n);
+    return v;
+}
+
+
+static void Usage()
+{
+    std::cerr << "Usage: throwstream-stats [-n count] [-j threads] [--chunk bytes] [--no-lines] file...\n"
+                 "  -n count       Number of callsites and chains to list (default 10)\n"
+                 "  -j threads     Number of threads (default: one per core)\n"
+                 "  --chunk bytes  Size of the pieces each file is split into (default 16 MB)\n"
+                 "  --no-lines     Group callsites by file and function only\n";
+}
+
+
+int main(int argc, char ** argv)
+{
+    try {
+        size_t top = 10;
+        size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+        size_t chunk = ChunkSize;
+        bool lines = true;
+        vector<const char *> files;
+
+        for(int i = 1; i < argc; i++)
+        {
+            const string arg = argv[i];
+            if((arg == "-n" || arg == "-j" || arg == "--chunk") && i + 1 < argc)
+            {
+                const long v = atol(argv[++i]);
+                if(v <= 0)
+                    THROWSTREAM << "Bad value for " << arg << ": " << argv[i];
+                if(arg == "-n")
+                    top = size_t(v);
+                else if(arg == "-j")
+                    nthreads = size_t(v);
+                else
+                    chunk = size_t(v);
+            }
+            else if(arg == "--no-lines")
+                lines = false;
+            else if(arg == "-h" || arg == "--help")
+            {
+                Usage();
+                return 0;
+            }
+            else if(arg.size() > 1 && arg[0] == '-')
+            {
+                Usage();
+                return 1;
+            }
+            else
+                files.push_back(argv[i]);
+        }
+
+        if(files.empty())
+        {
+            Usage();
+            return 1;
+        }
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        vector<Stats> stats(nthreads);
+        unsigned long long bytes = 0;
+        for(size_t i = 0; i < files.size(); i++)
+        {
+            ScanFile(files[i], chunk, lines, stats);
+
+            struct stat st;
+            if(stat(files[i], &st) == 0)
+                bytes += (unsigned long long)st.st_size;
+        }
+
+        for(size_t t = 1; t < stats.size(); t++)
+            stats[0].Merge(stats[t]);
+        const Stats & all = stats[0];
+
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        cout << "Scanned " << files.size() << " file" << (files.size() == 1 ? "" : "s")
+             << " (" << bytes / (1024 * 1024) << " MB) in " << secs << " s";
+        if(secs > 0)
+            cout << " (" << double(bytes) / (1024.0 * 1024.0 * secs) << " MB/s)";
+        cout << "\n" << all.exceptions << " exceptions\n";
+
+        cout << "\nTop callsites\n";
+        const vector<const Site *> sites = Top(all.sites, top);
+        for(size_t i = 0; i < sites.size(); i++)
+            cout << "  " << sites[i]->count << "\t" << sites[i]->text << "\n";
+
+        cout << "\nTop chains\n";
+        const vector<const Chain *> chains = Top(all.chains, top);
+        for(size_t i = 0; i < chains.size(); i++)
+        {
+            cout << "  " << chains[i]->count;
+            for(size_t j = 0; j < chains[i]->sites.size(); j++)
+                cout << "\t" << chains[i]->sites[j] << "\n";
+        }
+
+        cout << "\nExceptions per minute\n";
+        for(const auto & m : all.minutes)
+            cout << "  " << m.first << "\t" << m.second << "\n";
+    }
+    catch(const exception & ex)
+    {
+        std::cerr << "\nthrowstream-stats failed:" << ex.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}